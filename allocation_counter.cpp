@@ -0,0 +1,147 @@
+/*
+ * allocation_counter.cpp
+ *
+ * Counts the allocations of the program, for the benchmark and the tests. Linking allocation_counter.cpp replaces all
+ * forms of the global operator new and delete.
+ */
+
+#include "allocation_counter.hpp"
+#include <cstdlib>
+#include <new>
+
+std::atomic<size_t> allocations(0);
+std::atomic<size_t> allocated_bytes(0);
+
+namespace
+{
+/** counts and allocates size bytes with malloc(), or with aligned_alloc() for an alignment beyond that of malloc().
+ *
+ * All forms of operator delete release the memory with free(), which takes both.
+ *
+ * @return NULL if there is not enough memory.
+ */
+void *allocate(size_t size, size_t alignment = 0)
+{
+    allocations++;
+    allocated_bytes += size;
+    if (size == 0)
+    {
+        size = 1;
+    }
+    if (alignment == 0)
+    {
+        return malloc(size);
+    }
+    // aligned_alloc() requires a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void *allocate_or_throw(size_t size, size_t alignment = 0)
+{
+    if (void *memory = allocate(size, alignment))
+    {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+}
+
+void *operator new(size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate_or_throw(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+    return allocate_or_throw(size, size_t(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+    return allocate_or_throw(size, size_t(alignment));
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate(size, size_t(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    return allocate(size, size_t(alignment));
+}
+
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, const std::nothrow_t &) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, const std::nothrow_t &) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t, std::align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t, std::align_val_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    free(memory);
+}
@@ -0,0 +1,24 @@
+/*
+ * allocation_counter.hpp
+ *
+ * Counts the allocations of the program, for the benchmark and the tests. Linking allocation_counter.cpp replaces all
+ * forms of the global operator new and delete.
+ */
+
+#ifndef ALLOCATION_COUNTER_HPP
+#define ALLOCATION_COUNTER_HPP
+
+#include <atomic>
+#include <cstddef>
+
+/** calls of any operator new since the start of the program.
+ *
+ */
+extern std::atomic<size_t> allocations;
+
+/** bytes requested by these calls.
+ *
+ */
+extern std::atomic<size_t> allocated_bytes;
+
+#endif
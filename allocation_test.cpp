@@ -0,0 +1,161 @@
+/*
+ * allocation_test.cpp
+ *
+ * Checks that read_file() does not allocate per stroke: a section of many strokes may only allocate a few times more
+ * than a section of few strokes, for the growth of the reused buffers.
+ */
+
+#include "allocation_counter.hpp"
+#include "convert.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace
+{
+// strokes of the small and the large section. Both fill several windows of read_file() on 4 threads, as the lines of
+// the window reach their capacity in the first two.
+const size_t small_strokes = 15000;
+const size_t large_strokes = 45000;
+// points of the longest stroke, which is the first of each section.
+const size_t max_points = 120;
+// allocations the large section may need beyond the small one, for the growth of the frames and scratch buffers.
+const size_t allowed_growth = 64;
+
+/** discards everything written to it.
+ *
+ */
+class NullBuf : public std::streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char *, std::streamsize count) override
+    {
+        return count;
+    }
+};
+
+void append_varint(std::string &out, uint64_t value)
+{
+    while (value >= 128)
+    {
+        out += char(value | 128);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+void append_packed_sint32(std::string &out, uint32_t field, const std::vector<int32_t> &values)
+{
+    std::string packed;
+    for (int32_t value : values)
+    {
+        append_varint(packed, (uint32_t(value) << 1) ^ uint32_t(value >> 31));
+    }
+    append_varint(out, field << 3 | 2);
+    append_varint(out, packed.size());
+    out += packed;
+}
+
+/** a media section of length prefixed WacomInkFormat::Path messages with random deltas and widths.
+ *
+ */
+std::string make_section(size_t strokes)
+{
+    std::mt19937 random(1);
+    std::uniform_int_distribution<size_t> points(2, max_points);
+    std::uniform_int_distribution<int> delta(-300, 300);
+    std::string section;
+    for (size_t i = 0; i < strokes; i++)
+    {
+        size_t count = i == 0 ? max_points : points(random);
+        std::vector<int32_t> deltas(count * 2);
+        std::vector<int32_t> widths(count);
+        for (auto &value : deltas)
+        {
+            value = delta(random);
+        }
+        deltas[0] = 30000;
+        deltas[1] = 40000;
+        for (auto &value : widths)
+        {
+            value = delta(random) / 100;
+        }
+        widths[0] = 150;
+
+        std::string message;
+        append_varint(message, 3 << 3);
+        append_varint(message, 2);
+        append_packed_sint32(message, 4, deltas);
+        append_packed_sint32(message, 5, widths);
+        // a few pens, as a real page has, so the classes of the styles stop growing
+        append_packed_sint32(message, 6, {int32_t(0xff000000u | 0x404040 * (random() % 4))});
+        append_varint(section, message.size());
+        section += message;
+    }
+    return section;
+}
+
+/** the allocations of reading section with a new SectionReader into a new document.
+ *
+ */
+size_t count_allocations(const std::string &section, const ConvertOptions &options)
+{
+    NullBuf sink;
+    size_t before = allocations;
+    {
+        svg::Layout layout(svg::Dimensions(592.0, 864.0), svg::Layout::TopLeft);
+        SectionReader reader(options, layout);
+        svg::StreamingDocument doc(&sink, layout);
+        read_file((const unsigned char *) section.data(), section.size(), reader, doc);
+        doc.close();
+    }
+    return allocations - before;
+}
+}
+
+int main()
+{
+    struct Case
+    {
+        const char *name;
+        ConvertOptions options;
+    };
+    std::vector<Case> cases;
+    for (unsigned int threads : {1u, 4u})
+    {
+        ConvertOptions options;
+        options.decode_threads = threads;
+        cases.push_back(Case{"polyline", options});
+        options.shape = ConvertOptions::Path;
+        options.tolerance = 0.5;
+        cases.push_back(Case{"simplified path", options});
+        options.widths = true;
+        options.colors = true;
+        options.classes = true;
+        cases.push_back(Case{"outline", options});
+    }
+
+    std::string small_section = make_section(small_strokes);
+    std::string large_section = make_section(large_strokes);
+    bool ok = true;
+    for (auto &test : cases)
+    {
+        size_t small_allocations = count_allocations(small_section, test.options);
+        size_t large_allocations = count_allocations(large_section, test.options);
+        bool passed = large_allocations <= small_allocations + allowed_growth;
+        std::cout << (passed ? "ok   " : "FAIL ") << test.name << " on " << test.options.decode_threads
+                  << " threads: " << small_allocations << " allocations for " << small_strokes << " strokes, "
+                  << large_allocations << " for " << large_strokes << std::endl;
+        ok = ok && passed;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
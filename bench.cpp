@@ -0,0 +1,810 @@
+/*
+ * bench.cpp
+ *
+ * Benchmarks for the conversion pipeline.
+ *
+ * Each stage is measured on its own and end to end, over synthetic .will files of several sizes and over the .will
+ * files given on the command line. The results are printed as JSON.
+ */
+
+#include "allocation_counter.hpp"
+#include "convert.hpp"
+#include "delta_decode.hpp"
+#include "path_decoder.hpp"
+#include "raster.hpp"
+#include "server.hpp"
+#include "simple_svg_1.0.0.hpp"
+#include "will_reader.hpp"
+#include "zip_reader.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#ifdef WILL_TO_SVG_USE_PROTOBUF
+#include <will.pb.h>
+#endif
+#include <zlib.h>
+
+namespace
+{
+double min_seconds = 0.5;
+}
+
+/** runs f repeatedly for at least min_seconds and returns the mean seconds per run.
+ *
+ */
+template <typename F> double measure(F &&f)
+{
+    using clock = std::chrono::steady_clock;
+    size_t runs = 0;
+    auto start = clock::now();
+    std::chrono::duration<double> elapsed;
+    do
+    {
+        f();
+        runs++;
+        elapsed = clock::now() - start;
+    } while (elapsed.count() < min_seconds);
+    return elapsed.count() / runs;
+}
+
+/** collects the results as JSON objects.
+ *
+ */
+class Json
+{
+public:
+    void begin(const std::string &key = "")
+    {
+        name(key);
+        out += "{";
+        first = true;
+    }
+    void end()
+    {
+        out += "}";
+        first = false;
+    }
+    void begin_array(const std::string &key)
+    {
+        name(key);
+        out += "[";
+        first = true;
+    }
+    void end_array()
+    {
+        out += "]";
+        first = false;
+    }
+    void value(const std::string &key, double number)
+    {
+        name(key);
+        svg::appendNumber(out, number, std::fabs(number) < 1000 ? 6 : 0);
+    }
+    void value(const std::string &key, const std::string &text)
+    {
+        name(key);
+        out += "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out += '\\';
+            }
+            out += c;
+        }
+        out += "\"";
+    }
+
+    /** a stage, which processed bytes and points in seconds. Rates of 0 are left out.
+     *
+     */
+    void stage(const std::string &key, double seconds, double bytes, double points)
+    {
+        begin(key);
+        value("seconds", seconds);
+        if (bytes > 0)
+        {
+            value("mb_per_s", bytes / seconds / 1e6);
+        }
+        if (points > 0)
+        {
+            value("points_per_s", points / seconds);
+        }
+        end();
+    }
+
+    std::string out;
+
+private:
+    void name(const std::string &key)
+    {
+        if (!first)
+        {
+            out += ",";
+        }
+        first = false;
+        if (!key.empty())
+        {
+            out += "\"" + key + "\":";
+        }
+    }
+
+    bool first = true;
+};
+
+void append_varint(std::string &out, uint64_t value)
+{
+    while (value >= 128)
+    {
+        out += char(value | 128);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+void append_packed_sint32(std::string &out, uint32_t field, std::vector<int32_t> const &values)
+{
+    std::string packed;
+    for (int32_t value : values)
+    {
+        append_varint(packed, (uint32_t(value) << 1) ^ uint32_t(value >> 31));
+    }
+    append_varint(out, field << 3 | 2);
+    append_varint(out, packed.size());
+    out += packed;
+}
+
+/** a serialized WacomInkFormat::Path of a pen stroke with random deltas.
+ *
+ */
+std::string make_path_message(std::mt19937 &random, size_t points)
+{
+    std::uniform_int_distribution<int> delta(-300, 300);
+    std::vector<int32_t> deltas(points * 2);
+    std::vector<int32_t> widths(points);
+    for (auto &value : deltas)
+    {
+        value = delta(random);
+    }
+    deltas[0] = 30000;
+    deltas[1] = 40000;
+    // a pen of about 1.5 units, which varies a little from point to point
+    for (auto &value : widths)
+    {
+        value = delta(random) / 100;
+    }
+    widths[0] = 150;
+
+    std::string message;
+    append_varint(message, 3 << 3);
+    append_varint(message, 2);
+    append_packed_sint32(message, 4, deltas);
+    append_packed_sint32(message, 5, widths);
+    append_packed_sint32(message, 6, {int32_t(random())});
+    return message;
+}
+
+void append16(std::string &out, uint16_t value)
+{
+    out += char(value & 0xff);
+    out += char(value >> 8);
+}
+
+void append32(std::string &out, uint32_t value)
+{
+    append16(out, value & 0xffff);
+    append16(out, value >> 16);
+}
+
+/** writes a zip archive with deflated entries, as the .will files are.
+ *
+ */
+bool write_zip(const std::string &file_name, const std::vector<std::pair<std::string, std::string>> &entries)
+{
+    std::string archive;
+    std::string directory;
+    for (auto &entry : entries)
+    {
+        const std::string &content = entry.second;
+        std::string compressed(compressBound(content.size()) + 16, '\0');
+        z_stream stream = z_stream();
+        deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        stream.next_in = (Bytef *) content.data();
+        stream.avail_in = content.size();
+        stream.next_out = (Bytef *) &compressed[0];
+        stream.avail_out = compressed.size();
+        deflate(&stream, Z_FINISH);
+        compressed.resize(stream.total_out);
+        deflateEnd(&stream);
+        uint32_t crc = crc32(crc32(0, Z_NULL, 0), (const Bytef *) content.data(), content.size());
+
+        std::string header;
+        append16(header, 20);
+        append16(header, 0);
+        append16(header, 8);
+        append32(header, 0);
+        append32(header, crc);
+        append32(header, compressed.size());
+        append32(header, content.size());
+        append16(header, entry.first.size());
+        append16(header, 0);
+
+        append32(directory, 0x02014b50);
+        append16(directory, 20);
+        directory += header;
+        append16(directory, 0);
+        append16(directory, 0);
+        append16(directory, 0);
+        append32(directory, 0);
+        append32(directory, archive.size());
+        directory += entry.first;
+
+        append32(archive, 0x04034b50);
+        archive += header;
+        archive += entry.first;
+        archive += compressed;
+    }
+
+    std::string end;
+    append32(end, 0x06054b50);
+    append32(end, 0);
+    append16(end, entries.size());
+    append16(end, entries.size());
+    append32(end, directory.size());
+    append32(end, archive.size());
+    append16(end, 0);
+
+    std::ofstream ofs(file_name, std::ios::binary);
+    ofs << archive << directory << end;
+    return ofs.good();
+}
+
+/** writes a synthetic .will file with strokes of 2 to 2 * mean_points points.
+ *
+ */
+bool write_fixture(const std::string &file_name, size_t strokes, size_t mean_points)
+{
+    std::mt19937 random(strokes);
+    std::uniform_int_distribution<size_t> points(2, 2 * mean_points);
+    std::string section;
+    for (size_t i = 0; i < strokes; i++)
+    {
+        std::string message = make_path_message(random, points(random));
+        append_varint(section, message.size());
+        section += message;
+    }
+    return write_zip(file_name, {{"sections/media/0.protobuf", section}});
+}
+
+size_t file_size(const std::string &file_name)
+{
+    std::ifstream ifs(file_name, std::ios::binary | std::ios::ate);
+    return ifs.good() ? size_t(ifs.tellg()) : 0;
+}
+
+/** measures every stage of the conversion of will_file_name.
+ *
+ */
+void bench_file(
+    Json &json, const std::string &name, const std::string &will_file_name, const std::string &svg_file_name)
+{
+    // zip entry reading with libzip
+    std::vector<std::vector<unsigned char>> sections;
+    double section_bytes = 0;
+    double zip_seconds = measure([&]() {
+        sections.clear();
+        int error;
+        zip_t *archive = zip_open(will_file_name.c_str(), ZIP_RDONLY, &error);
+        if (archive == NULL)
+        {
+            return;
+        }
+        zip_stat_t stat;
+        for (zip_uint64_t i = 0; zip_stat_index(archive, i, 0, &stat) == 0; i++)
+        {
+            sections.emplace_back();
+            if (!is_media_section(stat.name) || !read_entry(archive, i, stat, sections.back()))
+            {
+                sections.pop_back();
+            }
+        }
+        zip_close(archive);
+    });
+    if (sections.empty())
+    {
+        std::cerr << "no media sections in " << will_file_name << std::endl;
+        return;
+    }
+    for (auto &section : sections)
+    {
+        section_bytes += section.size();
+    }
+
+    // zip entry reading from a memory mapping
+    double mmap_seconds = measure([&]() {
+        MappedArchive archive;
+        archive.open(will_file_name);
+        std::vector<unsigned char> buffer;
+        for (auto &entry : archive.entries())
+        {
+            const unsigned char *data;
+            size_t size;
+            if (is_media_section(entry.name))
+            {
+                archive.read(entry, buffer, data, size);
+            }
+        }
+    });
+
+    // varint framing
+    std::vector<std::vector<Frame>> frames(sections.size());
+    double framing_seconds = measure([&]() {
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            split_frames(sections[i].data(), sections[i].size(), frames[i]);
+        }
+    });
+
+    // protobuf parsing, keeping the deltas for the next stage
+    std::vector<std::vector<int32_t>> deltas;
+    DecodeScratch scratch;
+    double strokes = 0;
+    double points = 0;
+    for (auto &section_frames : frames)
+    {
+        for (auto &frame : section_frames)
+        {
+            parsePath(frame.data, frame.len, scratch);
+            deltas.push_back(scratch.path.points);
+            strokes++;
+            points += scratch.path.points.size() / 2;
+        }
+    }
+    double parse_seconds = measure([&]() {
+        for (auto &section_frames : frames)
+        {
+            for (auto &frame : section_frames)
+            {
+                parsePath(frame.data, frame.len, scratch);
+            }
+        }
+    });
+
+    // delta decoding
+    std::vector<double> coordinates;
+    double delta_seconds = measure([&]() {
+        for (auto &stroke : deltas)
+        {
+            coordinates.resize(stroke.size());
+            delta_decode(stroke.data(), stroke.size(), 100.0, coordinates.data());
+        }
+    });
+
+    // parsing and delta decoding into polylines, keeping them for the next stages
+    std::vector<svg::Polyline> polylines;
+    std::vector<std::vector<double>> widths;
+    for (auto &section_frames : frames)
+    {
+        for (auto &frame : section_frames)
+        {
+            polylines.emplace_back(svg::Fill(svg::Color::White), svg::Stroke(1, svg::Color::Black));
+            getPath(frame.data, frame.len, scratch, polylines.back());
+            widths.emplace_back();
+            getWidths(scratch, widths.back());
+        }
+    }
+    // collecting the strokes of the file as polylines, each decoded with its exact size and moved into the vector.
+    // Beyond the points themselves, only the growth of the vector should allocate.
+    size_t collect_allocations;
+    size_t collect_bytes;
+    {
+        std::vector<svg::Polyline> collected;
+        size_t allocations_before = allocations;
+        size_t bytes_before = allocated_bytes;
+        for (auto &section_frames : frames)
+        {
+            for (auto &frame : section_frames)
+            {
+                svg::Polyline line(svg::Fill(svg::Color::White), svg::Stroke(1, svg::Color::Black));
+                getPath(frame.data, frame.len, scratch, line);
+                collected.push_back(std::move(line));
+            }
+        }
+        collect_allocations = allocations - allocations_before;
+        collect_bytes = allocated_bytes - bytes_before;
+    }
+
+    double get_path_seconds = measure([&]() {
+        size_t i = 0;
+        for (auto &section_frames : frames)
+        {
+            for (auto &frame : section_frames)
+            {
+                getPath(frame.data, frame.len, scratch, polylines[i++]);
+            }
+        }
+    });
+
+    // simplification, on a copy of the points as it removes them
+    std::vector<svg::Point> simplified;
+    double simplify_seconds = measure([&]() {
+        for (auto &polyline : polylines)
+        {
+            simplified = polyline.points;
+            simplify(simplified, 0.1, scratch.simplify);
+        }
+    });
+
+    // outlines of the strokes of variable width, on a copy of the points as it replaces them
+    std::vector<svg::Point> outlined;
+    double outline_seconds = measure([&]() {
+        for (size_t i = 0; i < polylines.size(); i++)
+        {
+            outlined = polylines[i].points;
+            outline(outlined, widths[i], scratch.outline);
+        }
+    });
+
+    // serialization
+    svg::Layout layout(svg::Dimensions(592.0, 864.0), svg::Layout::TopLeft);
+    std::string buffer;
+    double svg_bytes = 0;
+    double to_string_seconds = measure([&]() {
+        svg_bytes = 0;
+        for (auto &polyline : polylines)
+        {
+            buffer.clear();
+            polyline.appendTo(buffer, layout);
+            svg_bytes += buffer.size();
+        }
+    });
+
+    svg::Document doc(svg_file_name, layout);
+    for (auto &polyline : polylines)
+    {
+        doc << polyline;
+    }
+    double save_seconds = measure([&]() { doc.save(); });
+
+    // rasterizing a thumbnail of the decoded strokes, on a single thread and on all cores
+    Raster raster(layout, 1024);
+    for (auto &polyline : polylines)
+    {
+        raster.add_line(polyline.points, 1, svg::Color::Black);
+    }
+    double raster_seconds = measure([&]() { raster.render(1); });
+    unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    double raster_parallel_seconds = measure([&]() { raster.render(cores); });
+    std::stringbuf png_buffer;
+    double png_seconds = measure([&]() {
+        png_buffer.str(std::string());
+        raster.write_png(&png_buffer, -1);
+    });
+    double png_bytes = png_buffer.str().size();
+
+    // decoding with libwill, handing each stroke to a visitor without building polylines
+    struct CountingVisitor : StrokeVisitor
+    {
+        size_t points = 0;
+        bool stroke(const StrokeView &stroke) override
+        {
+            points += stroke.point_count;
+            return true;
+        }
+    } visitor;
+    double visit_seconds = measure([&]() { visit_will_file(will_file_name, visitor, true); });
+
+    // end to end
+    ConvertOptions options;
+    double end_to_end_seconds = measure([&]() { convert_file(will_file_name, svg_file_name, options); });
+    size_t allocations_before = allocations;
+    convert_file(will_file_name, svg_file_name, options);
+    size_t end_to_end_allocations = allocations - allocations_before;
+
+    options.mmap = true;
+    double end_to_end_mmap_seconds = measure([&]() { convert_file(will_file_name, svg_file_name, options); });
+    options.mmap = false;
+
+    // a request to a running server, which saves the startup of a process
+    ConversionServer server(options, 1);
+    std::string socket_file_name = will_file_name + ".sock";
+    server.listen(socket_file_name);
+    std::thread server_thread(&ConversionServer::run, &server);
+    std::vector<std::pair<std::string, std::string>> jobs{{will_file_name, svg_file_name}};
+    double server_roundtrip_seconds = measure([&]() { convert_remote(socket_file_name, jobs, -1, false); });
+    server.stop();
+    server_thread.join();
+
+    std::string svgz_file_name = svg_file_name + "z";
+    double end_to_end_svgz_seconds = measure([&]() { convert_file(will_file_name, svgz_file_name, options); });
+    double svgz_bytes = file_size(svgz_file_name);
+    unlink(svgz_file_name.c_str());
+
+    std::string png_file_name = svg_file_name + ".png";
+    options.raster_size = 1024;
+    double end_to_end_png_seconds = measure([&]() { convert_file(will_file_name, png_file_name, options); });
+    options.raster_size = 0;
+    unlink(png_file_name.c_str());
+
+    double input_bytes = file_size(will_file_name);
+    double output_bytes = file_size(svg_file_name);
+    unlink(svg_file_name.c_str());
+
+    json.begin();
+    json.value("name", name);
+    json.value("file_bytes", input_bytes);
+    json.value("section_bytes", section_bytes);
+    json.value("svg_bytes", output_bytes);
+    json.value("svgz_bytes", svgz_bytes);
+    json.value("png_bytes", png_bytes);
+    json.value("strokes", strokes);
+    json.value("points", points);
+    json.value("end_to_end_allocations", end_to_end_allocations);
+    json.value("collect_allocations", collect_allocations);
+    json.value("collect_allocated_bytes", collect_bytes);
+    json.value("point_bytes", points * sizeof(svg::Point));
+    json.begin("stages");
+    json.stage("zip_read", zip_seconds, section_bytes, 0);
+    json.stage("zip_read_mmap", mmap_seconds, section_bytes, 0);
+    json.stage("framing", framing_seconds, section_bytes, 0);
+    json.stage("parse", parse_seconds, section_bytes, points);
+    json.stage("delta_decode", delta_seconds, 0, points);
+    json.stage("get_path", get_path_seconds, section_bytes, points);
+    json.stage("simplify", simplify_seconds, 0, points);
+    json.stage("outline", outline_seconds, 0, points);
+    json.stage("to_string", to_string_seconds, svg_bytes, points);
+    json.stage("document_save", save_seconds, output_bytes, points);
+    json.stage("visit_strokes", visit_seconds, input_bytes, points);
+    json.stage("raster_1024", raster_seconds, 0, points);
+    json.stage("raster_1024_parallel", raster_parallel_seconds, 0, points);
+    json.stage("png_encode", png_seconds, png_bytes, 0);
+    json.stage("end_to_end", end_to_end_seconds, input_bytes, points);
+    json.stage("end_to_end_mmap", end_to_end_mmap_seconds, input_bytes, points);
+    json.stage("end_to_end_svgz", end_to_end_svgz_seconds, input_bytes, points);
+    json.stage("end_to_end_png", end_to_end_png_seconds, input_bytes, points);
+    json.stage("server_roundtrip", server_roundtrip_seconds, input_bytes, points);
+    json.end();
+    json.end();
+}
+
+/** the points of a pen stroke with the two decimals the .will files usually have.
+ *
+ */
+svg::Polyline make_polyline(size_t points)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> delta(-300, 300);
+    svg::Polyline polyline(svg::Fill(svg::Color::White), svg::Stroke(1, svg::Color::Black));
+    polyline.setPrecision(2);
+    int x = 30000;
+    int y = 40000;
+    for (size_t i = 0; i < points; i++)
+    {
+        x += delta(random);
+        y += delta(random);
+        polyline << svg::Point(x / 100.0, y / 100.0);
+    }
+    return polyline;
+}
+
+/** Polyline::toString() as it was before appendNumber(), for comparison.
+ *
+ */
+std::string stringstream_to_string(svg::Polyline const &polyline, svg::Layout const &layout)
+{
+    std::stringstream ss;
+    ss << svg::elemStart("polyline");
+
+    ss << "points=\"";
+    for (unsigned i = 0; i < polyline.points.size(); ++i)
+        ss << svg::translateX(polyline.points[i].x, layout) << "," << svg::translateY(polyline.points[i].y, layout)
+           << " ";
+    ss << "\" ";
+    return ss.str();
+}
+
+void bench_polyline(Json &json, size_t points)
+{
+    svg::Layout layout(svg::Dimensions(592.0, 864.0), svg::Layout::TopLeft);
+    svg::Polyline polyline = make_polyline(points);
+
+    size_t bytes = 0;
+    double stringstream_seconds = measure([&]() { bytes = stringstream_to_string(polyline, layout).size(); });
+
+    std::string buffer;
+    double append_seconds = measure([&]() {
+        buffer.clear();
+        polyline.appendTo(buffer, layout);
+    });
+
+    json.stage("polyline_stringstream", stringstream_seconds, bytes, points);
+    json.stage("polyline_append", append_seconds, buffer.size(), points);
+
+    // an A0 page with the origin at the bottom, which flips and scales every coordinate
+    svg::Layout large_page(svg::Dimensions(2384.0, 3370.0), svg::Layout::BottomLeft, 4, svg::Point(10, 10));
+    double large_page_seconds = measure([&]() {
+        buffer.clear();
+        polyline.appendTo(buffer, large_page);
+    });
+    json.stage("polyline_append_large_page", large_page_seconds, buffer.size(), points);
+
+    svg::Path path(svg::Fill(), svg::Stroke(1, svg::Color::Black));
+    path.points = polyline.points;
+    double path_seconds = measure([&]() {
+        buffer.clear();
+        path.appendTo(buffer, large_page);
+    });
+    json.stage("path_append_large_page", path_seconds, buffer.size(), points);
+
+    // the layout transform alone, per coordinate as before and in bulk
+    std::vector<double> native(2 * points);
+    double translate_seconds = measure([&]() {
+        for (size_t i = 0; i < points; i++)
+        {
+            native[2 * i] = svg::translateX(polyline.points[i].x, large_page);
+            native[2 * i + 1] = svg::translateY(polyline.points[i].y, large_page);
+        }
+    });
+    double transform_seconds = measure([&]() { svg::transformPoints(polyline.points, large_page, native); });
+    json.stage("translate_per_coordinate", translate_seconds, 0, points);
+    json.stage("transform_points", transform_seconds, 0, points);
+}
+
+/** the delta decoding of getPath() before the kernels, for comparison.
+ *
+ */
+void loop_delta_decode(std::vector<int32_t> const &deltas, double dp, svg::Polyline &polyline)
+{
+    polyline.points.clear();
+    std::vector<int32_t> integer_values(deltas.size(), 0);
+
+    integer_values[0] = deltas[0];
+    integer_values[1] = deltas[1];
+    for (size_t i = 2; i < deltas.size(); i += 2)
+    {
+        integer_values[i] = integer_values[i - 2] + deltas[i];
+        integer_values[i + 1] = integer_values[i - 1] + deltas[i + 1];
+    }
+
+    for (size_t i = 0; i < deltas.size(); i += 2)
+    {
+        polyline << svg::Point(integer_values[i] / std::pow(10.0, dp), integer_values[i + 1] / std::pow(10.0, dp));
+    }
+}
+
+void bench_delta_decode(Json &json, size_t points)
+{
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> delta(-300, 300);
+    std::vector<int32_t> deltas(points * 2);
+    for (auto &value : deltas)
+    {
+        value = delta(random);
+    }
+    double dp = 2;
+
+    svg::Polyline polyline;
+    double loop_seconds = measure([&]() { loop_delta_decode(deltas, dp, polyline); });
+    json.stage("delta_loop", loop_seconds, 0, points);
+
+    polyline.points.resize(points);
+    for (const char *name : {"scalar", "sse2", "avx2"})
+    {
+        DeltaDecodeKernel kernel = delta_decode_kernel(name);
+        if (kernel == NULL)
+        {
+            continue;
+        }
+        double *out = (double *) polyline.points.data();
+        double seconds = measure([&]() { kernel(deltas.data(), deltas.size(), std::pow(10.0, dp), out); });
+        json.stage(std::string("delta_") + name, seconds, 0, points);
+    }
+}
+
+void bench_path_decoder(Json &json, size_t strokes, size_t points)
+{
+    std::mt19937 random(42);
+    std::vector<std::string> messages;
+    size_t bytes = 0;
+    for (size_t i = 0; i < strokes; i++)
+    {
+        messages.push_back(make_path_message(random, points));
+        bytes += messages.back().size();
+    }
+
+    PathData path;
+    double native_seconds = measure([&]() {
+        for (auto &message : messages)
+        {
+            decode_path((const unsigned char *) message.data(), message.size(), path);
+        }
+    });
+    json.stage("decode_path", native_seconds, bytes, strokes * points);
+
+#ifdef WILL_TO_SVG_USE_PROTOBUF
+    WacomInkFormat::Path message_path;
+    double protobuf_seconds = measure([&]() {
+        for (auto &message : messages)
+        {
+            message_path.ParseFromArray(message.data(), message.size());
+        }
+    });
+    json.stage("protobuf_parse", protobuf_seconds, bytes, strokes * points);
+#endif
+}
+
+void print_help(char *program_name)
+{
+    std::cerr << "Usage: " << std::string(program_name) << " [-q] [will_file ...]\n"
+              << "  -q  measure each stage for 0.05 s instead of 0.5 s\n";
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "q")) != -1)
+    {
+        switch (opt)
+        {
+        case 'q':
+            min_seconds = 0.05;
+            break;
+        default: /* '?' */
+            print_help(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char directory_template[] = "/tmp/will_to_svg_bench.XXXXXX";
+    if (mkdtemp(directory_template) == NULL)
+    {
+        std::cerr << "error creating a temporary directory" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::string directory(directory_template);
+
+    struct Fixture
+    {
+        std::string name;
+        size_t strokes;
+        size_t mean_points;
+    };
+    Json json;
+    json.begin();
+    json.begin_array("files");
+    for (auto &fixture : {Fixture{"small", 100, 60}, Fixture{"medium", 5000, 60}, Fixture{"large", 50000, 60}})
+    {
+        std::string will_file_name = directory + "/" + fixture.name + ".will";
+        if (!write_fixture(will_file_name, fixture.strokes, fixture.mean_points))
+        {
+            std::cerr << "error writing " << will_file_name << std::endl;
+            continue;
+        }
+        bench_file(json, fixture.name, will_file_name, directory + "/out.svg");
+        unlink(will_file_name.c_str());
+    }
+    for (int i = optind; i < argc; i++)
+    {
+        bench_file(json, argv[i], argv[i], directory + "/out.svg");
+    }
+    json.end_array();
+
+    json.begin("kernels");
+    bench_polyline(json, 1000000);
+    bench_delta_decode(json, 1000000);
+    bench_path_decoder(json, 10000, 100);
+    json.end();
+    json.end();
+    rmdir(directory.c_str());
+
+    std::cout << json.out << std::endl;
+}
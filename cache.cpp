@@ -0,0 +1,283 @@
+/*
+ * cache.cpp
+ *
+ * Cache of the conversions, that skips .will files whose svg is still current.
+ */
+
+#include "cache.hpp"
+#include "gzip_file.hpp"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+// Changes of the svg, that the options do not show, have to increase the version to invalidate old entries.
+const char *cache_version = "will_to_svg cache 1";
+
+const uint64_t prime1 = 11400714785074694791ULL;
+const uint64_t prime2 = 14029467366897019727ULL;
+const uint64_t prime3 = 1609587929392839161ULL;
+const uint64_t prime4 = 9650029242287828579ULL;
+const uint64_t prime5 = 2870177450012600261ULL;
+
+inline uint64_t rotate_left(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t read64(const unsigned char *pos)
+{
+    uint64_t value;
+    std::memcpy(&value, pos, sizeof(value));
+    return value;
+}
+
+inline uint32_t read32(const unsigned char *pos)
+{
+    uint32_t value;
+    std::memcpy(&value, pos, sizeof(value));
+    return value;
+}
+
+inline uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * prime2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * prime1;
+}
+
+inline uint64_t hash_merge(uint64_t hash, uint64_t accumulator)
+{
+    hash ^= hash_round(0, accumulator);
+    return hash * prime1 + prime4;
+}
+
+/** the name of the entry of svg_file_name, which is the hash of its absolute path.
+ *
+ * @return false if the svg file does not exist.
+ */
+bool entry_name(const std::string &cache_dir, const std::string &svg_file_name, std::string &path, std::string &entry)
+{
+    char *resolved = realpath(svg_file_name.c_str(), NULL);
+    if (resolved == NULL)
+    {
+        return false;
+    }
+    path = resolved;
+    std::free(resolved);
+
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016" PRIx64, hash64((const unsigned char *) path.data(), path.size()));
+    entry = cache_dir + "/" + name;
+    return true;
+}
+
+/** the line of an entry, which has to match for the svg file to be current.
+ *
+ */
+bool entry_line(const std::string &svg_file_name, uint64_t key, std::string &line)
+{
+    struct stat svg_stat;
+    if (stat(svg_file_name.c_str(), &svg_stat) != 0)
+    {
+        return false;
+    }
+    char buffer[128];
+    std::snprintf(buffer, sizeof(buffer), "%016" PRIx64 " %lld %lld.%09ld\n", key, (long long) svg_stat.st_size,
+        (long long) svg_stat.st_mtim.tv_sec, svg_stat.st_mtim.tv_nsec);
+    line = buffer;
+    return true;
+}
+}
+
+uint64_t hash64(const unsigned char *data, size_t size, uint64_t seed)
+{
+    const unsigned char *pos = data;
+    const unsigned char *end = data + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+        for (; pos + 32 <= end; pos += 32)
+        {
+            v1 = hash_round(v1, read64(pos));
+            v2 = hash_round(v2, read64(pos + 8));
+            v3 = hash_round(v3, read64(pos + 16));
+            v4 = hash_round(v4, read64(pos + 24));
+        }
+        hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+        hash = hash_merge(hash, v1);
+        hash = hash_merge(hash, v2);
+        hash = hash_merge(hash, v3);
+        hash = hash_merge(hash, v4);
+    }
+    else
+    {
+        hash = seed + prime5;
+    }
+    hash += size;
+
+    for (; pos + 8 <= end; pos += 8)
+    {
+        hash ^= hash_round(0, read64(pos));
+        hash = rotate_left(hash, 27) * prime1 + prime4;
+    }
+    if (pos + 4 <= end)
+    {
+        hash ^= read32(pos) * prime1;
+        hash = rotate_left(hash, 23) * prime2 + prime3;
+        pos += 4;
+    }
+    for (; pos < end; pos++)
+    {
+        hash ^= *pos * prime5;
+        hash = rotate_left(hash, 11) * prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+bool cache_key(const std::string &will_file_name,
+    const std::string &svg_file_name,
+    const ConvertOptions &options,
+    uint64_t &key)
+{
+    // The threads and the way the archive is read do not change the svg.
+    std::ostringstream settings;
+    settings.precision(17);
+    settings << cache_version << ";tolerance=" << options.tolerance << ";shape=" << options.shape
+             << ";widths=" << options.widths << ";colors=" << options.colors << ";classes=" << options.classes;
+    if (options.raster_size > 0)
+    {
+        settings << ";png=" << options.raster_size << ";compression_level=" << options.compression_level;
+    }
+    else if (is_svgz(svg_file_name))
+    {
+        settings << ";compression_level=" << options.compression_level;
+    }
+    std::string setting_string = settings.str();
+    uint64_t seed = hash64((const unsigned char *) setting_string.data(), setting_string.size());
+
+    int fd = open(will_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat will_stat;
+    if (fstat(fd, &will_stat) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = will_stat.st_size;
+    if (size == 0)
+    {
+        close(fd);
+        key = hash64(NULL, 0, seed);
+        return true;
+    }
+    if (!options.mmap)
+    {
+        // read() only returns less when the file shrinks, where a mapping would raise SIGBUS
+        std::vector<unsigned char> data(size);
+        size_t read_size = 0;
+        while (read_size < size)
+        {
+            ssize_t count = read(fd, data.data() + read_size, size - read_size);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count < 0)
+            {
+                close(fd);
+                return false;
+            }
+            if (count == 0)
+            {
+                break;
+            }
+            read_size += count;
+        }
+        close(fd);
+        key = hash64(data.data(), read_size, seed);
+        return true;
+    }
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    key = hash64((const unsigned char *) data, size, seed);
+    munmap(data, size);
+    return true;
+}
+
+bool cache_current(const std::string &cache_dir, const std::string &svg_file_name, uint64_t key)
+{
+    std::string path;
+    std::string entry;
+    std::string expected;
+    if (!entry_name(cache_dir, svg_file_name, path, entry) || !entry_line(svg_file_name, key, expected))
+    {
+        return false;
+    }
+    expected += path + "\n";
+
+    char buffer[8192];
+    int fd = open(entry.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ssize_t size = read(fd, buffer, sizeof(buffer));
+    close(fd);
+    return size == ssize_t(expected.size()) && expected.compare(0, expected.size(), buffer, size) == 0;
+}
+
+bool cache_store(const std::string &cache_dir, const std::string &svg_file_name, uint64_t key)
+{
+    std::string path;
+    std::string entry;
+    std::string content;
+    if (!entry_name(cache_dir, svg_file_name, path, entry) || !entry_line(svg_file_name, key, content))
+    {
+        return false;
+    }
+    content += path + "\n";
+
+    std::string temporary = cache_dir + "/.entry.XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool written = write(fd, content.data(), content.size()) == ssize_t(content.size());
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), entry.c_str()) != 0)
+    {
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
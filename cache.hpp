@@ -0,0 +1,46 @@
+/*
+ * cache.hpp
+ *
+ * Cache of the conversions, that skips .will files whose svg is still current.
+ */
+
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include "convert.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** the 64 bit hash XXH64 of data.
+ *
+ */
+uint64_t hash64(const unsigned char *data, size_t size, uint64_t seed = 0);
+
+/** the key of a conversion, which is the hash of the content of the .will file and of all options that change the
+ * svg. The .will file is read with read(), or mapped into memory with options.mmap.
+ *
+ * @return false if the .will file can not be read.
+ */
+bool cache_key(const std::string &will_file_name,
+    const std::string &svg_file_name,
+    const ConvertOptions &options,
+    uint64_t &key);
+
+/** checks whether the cache in cache_dir records svg_file_name as the output of key.
+ *
+ * The cache has one entry per svg file, with the key it was written for and its size and modification time. The svg
+ * file is current, if the key matches and the file was not changed since.
+ */
+bool cache_current(const std::string &cache_dir, const std::string &svg_file_name, uint64_t key);
+
+/** records svg_file_name as the output of key.
+ *
+ * The entry is written to a temporary file, that is renamed over the old entry. So processes sharing cache_dir see
+ * either the old or the new entry, never a partial one.
+ *
+ * @return false if the entry could not be written.
+ */
+bool cache_store(const std::string &cache_dir, const std::string &svg_file_name, uint64_t key);
+
+#endif
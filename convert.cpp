@@ -0,0 +1,660 @@
+/*
+ * convert.cpp
+ *
+ * Conversion of the media sections of a .will file to svg.
+ */
+
+#include "convert.hpp"
+#include "cache.hpp"
+#include "delta_decode.hpp"
+#include "gzip_file.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+bool parsePath(const unsigned char *data, uint len, DecodeScratch &scratch)
+{
+    return scratch.parser.parse(data, len, scratch.path);
+}
+
+void getPath(const unsigned char *data, uint len, DecodeScratch &scratch, svg::Polyline &polyline)
+{
+    PathData &path = scratch.path;
+    polyline.points.clear();
+
+    if (!parsePath(data, len, scratch))
+    {
+        std::cerr << "Failed to parse will." << std::endl;
+    }
+    double dp = 0;
+    dp = path.decimal_precision;
+    polyline.setPrecision(dp);
+
+    // A trailing x without y is dropped.
+    size_t count = path.points.size() & ~1;
+    if (count > 0)
+    {
+        static_assert(sizeof(svg::Point) == 2 * sizeof(double), "svg::Point has to be an x/y pair of doubles");
+        polyline.points.resize(count / 2);
+        delta_decode(path.points.data(), count, std::pow(10.0, dp), (double *) polyline.points.data());
+    }
+}
+
+void getWidths(const DecodeScratch &scratch, std::vector<double> &widths)
+{
+    decode_widths(scratch.path, widths);
+}
+
+bool getColor(const DecodeScratch &scratch, svg::Color &color)
+{
+    StrokeColor decoded;
+    if (!decode_color(scratch.path, decoded))
+    {
+        return false;
+    }
+    color = svg::Color(decoded.red, decoded.green, decoded.blue);
+    return true;
+}
+
+namespace
+{
+/** decodes, simplifies and, if it has a variable width, outlines the stroke in frame.
+ *
+ */
+void decode_stroke(const Frame &frame, SectionReader &reader, DecodeScratch &scratch, DecodedStroke &stroke)
+{
+    svg::Polyline &line = stroke.line;
+    line.points.reserve(reader.line_capacity);
+    getPath(frame.data, frame.len, scratch, line);
+    scratch.points += line.points.size();
+    stroke.width = -1;
+    stroke.outline = false;
+    stroke.color = svg::Color::Black;
+    if (reader.colors)
+    {
+        getColor(scratch, stroke.color);
+    }
+    if (!reader.widths)
+    {
+        simplify(line.points, reader.tolerance, scratch.simplify);
+        return;
+    }
+
+    std::vector<double> &widths = scratch.widths;
+    getWidths(scratch, widths);
+    simplify(line.points, widths, reader.tolerance, scratch.simplify);
+    if (widths.size() == 1)
+    {
+        stroke.width = widths[0];
+    }
+    else if (widths.size() == line.points.size() && !widths.empty())
+    {
+        outline(line.points, widths, scratch.outline);
+        stroke.outline = true;
+    }
+}
+
+/** sets the pen of a stroke on the shape it is written as.
+ *
+ * Outlines are filled with the color of the pen, center lines are stroked with it.
+ */
+void apply_pen(SectionReader &reader, const DecodedStroke &stroke, svg::Shape &shape, svg::StreamingDocument &doc)
+{
+    if (stroke.outline)
+    {
+        shape.setFill(svg::Fill(stroke.color));
+    }
+    else
+    {
+        shape.setStroke(svg::Stroke(stroke.width < 0 ? 1 : stroke.width, stroke.color));
+    }
+    if (reader.classes)
+    {
+        shape.setClass(doc.classFor(shape));
+    }
+}
+
+/** writes a stroke as the shape chosen in the options.
+ *
+ * The points are lent to the reused shapes of reader instead of copied.
+ */
+void write_stroke(SectionReader &reader, DecodedStroke &stroke, svg::StreamingDocument &doc)
+{
+    svg::Polyline &line = stroke.line;
+    if (reader.shape == ConvertOptions::Path)
+    {
+        svg::Path &path = stroke.outline ? reader.outline_path : reader.path;
+        apply_pen(reader, stroke, path, doc);
+        path.points.swap(line.points);
+        path.setPrecision(line.getPrecision());
+        doc << path;
+        path.points.swap(line.points);
+    }
+    else if (stroke.outline)
+    {
+        svg::Polygon &polygon = reader.outline_polygon;
+        apply_pen(reader, stroke, polygon, doc);
+        polygon.points.swap(line.points);
+        polygon.setPrecision(line.getPrecision());
+        doc << polygon;
+        polygon.points.swap(line.points);
+    }
+    else
+    {
+        apply_pen(reader, stroke, line, doc);
+        doc << line;
+    }
+}
+}
+
+DecodeWorkers::~DecodeWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void DecodeWorkers::run(size_t threads, const std::function<void(size_t)> &task)
+{
+    if (threads <= 1)
+    {
+        task(0);
+        return;
+    }
+    while (workers.size() < threads - 1)
+    {
+        workers.emplace_back(&DecodeWorkers::work, this, workers.size() + 1);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        participants = threads;
+        pending = threads - 1;
+        generation++;
+    }
+    started.notify_all();
+    task(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return pending == 0; });
+    this->task = NULL;
+}
+
+void DecodeWorkers::work(size_t index)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        started.wait(lock, [&]() { return stopping || generation != seen; });
+        if (stopping)
+        {
+            return;
+        }
+        seen = generation;
+        // A window with fewer blocks than threads leaves the last workers idle.
+        if (index >= participants)
+        {
+            continue;
+        }
+        const std::function<void(size_t)> *current = task;
+        lock.unlock();
+        (*current)(index);
+        lock.lock();
+        if (--pending == 0)
+        {
+            finished.notify_one();
+        }
+    }
+}
+
+namespace
+{
+/** writes a stroke into every tile it overlaps.
+ *
+ */
+void write_tiled(SectionReader &reader, DecodedStroke &stroke, TileWriter &tiles)
+{
+    // Center lines reach half the width of the pen beyond their points.
+    double margin = stroke.outline ? 0 : (stroke.width < 0 ? 1 : stroke.width) / 2;
+    size_t first_column, first_row, last_column, last_row;
+    if (!tiles.tiles_of(stroke.line.points, margin, first_column, first_row, last_column, last_row))
+    {
+        return;
+    }
+    for (size_t row = first_row; row <= last_row; row++)
+    {
+        for (size_t column = first_column; column <= last_column; column++)
+        {
+            write_stroke(reader, stroke, tiles.tile(column, row));
+            tiles.count_stroke(column, row);
+        }
+    }
+}
+
+/** adds a stroke to raster, with the pen it would have in the svg.
+ *
+ */
+void draw_stroke(const DecodedStroke &stroke, Raster &raster)
+{
+    if (stroke.outline)
+    {
+        raster.add_outline(stroke.line.points, stroke.color);
+    }
+    else
+    {
+        raster.add_line(stroke.line.points, stroke.width < 0 ? 1 : stroke.width, stroke.color);
+    }
+}
+
+/** decodes the strokes of a section as read_file() describes, and hands them to write in the order of the file.
+ *
+ */
+template <typename Write> void read_strokes(const unsigned char *data, size_t size, SectionReader &reader, Write write)
+{
+    // A single thread parses and writes one stroke at a time.
+    const size_t block_size = reader.threads == 1 ? 1 : 256;
+    const size_t window_size = reader.threads == 1 ? 1 : block_size * 4 * reader.threads;
+
+    std::vector<Frame> &frames = reader.frames;
+    {
+        StageTimer timer(reader.stats, ConversionStats::Split);
+        split_frames(data, size, frames);
+    }
+
+    if (reader.window.empty())
+    {
+        DecodedStroke stroke;
+        stroke.line = svg::Polyline(svg::Fill(svg::Color::White), svg::Stroke(1, svg::Color::Black));
+        reader.window.resize(window_size, stroke);
+    }
+
+    for (size_t window_begin = 0; window_begin < frames.size(); window_begin += window_size)
+    {
+        size_t window_end = std::min(window_begin + window_size, frames.size());
+
+        std::atomic<size_t> next_block(0);
+        auto parse = [&](DecodeScratch &scratch) {
+            for (size_t begin = window_begin + next_block++ * block_size; begin < window_end;
+                 begin = window_begin + next_block++ * block_size)
+            {
+                size_t end = std::min(begin + block_size, window_end);
+                for (size_t i = begin; i < end; i++)
+                {
+                    decode_stroke(frames[i], reader, scratch, reader.window[i - window_begin]);
+                }
+            }
+        };
+
+        {
+            StageTimer timer(reader.stats, ConversionStats::Decode);
+            // Small sections are always parsed sequentially.
+            size_t blocks = (window_end - window_begin + block_size - 1) / block_size;
+            size_t threads = std::min<size_t>(reader.threads, blocks);
+            reader.workers.run(threads, [&](size_t index) {
+                parse(reader.scratch[index]);
+            });
+        }
+
+        StageTimer timer(reader.stats, ConversionStats::Write);
+        for (size_t i = 0; i < window_end - window_begin; i++)
+        {
+            write(reader.window[i]);
+            while (reader.line_capacity < reader.window[i].line.points.size())
+            {
+                reader.line_capacity *= 2;
+            }
+        }
+        if (reader.stats != NULL)
+        {
+            for (size_t i = 0; i < window_end - window_begin; i++)
+            {
+                reader.stats->written_points += reader.window[i].line.points.size();
+            }
+        }
+    }
+
+    if (reader.stats != NULL)
+    {
+        reader.stats->sections++;
+        reader.stats->strokes += frames.size();
+        for (auto &scratch : reader.scratch)
+        {
+            reader.stats->points += scratch.points;
+            scratch.points = 0;
+        }
+    }
+}
+}
+
+void read_file(const unsigned char *data, size_t size, SectionReader &reader, svg::StreamingDocument &doc)
+{
+    read_strokes(data, size, reader, [&](DecodedStroke &stroke) {
+        write_stroke(reader, stroke, doc);
+    });
+}
+
+void read_tiles(const unsigned char *data, size_t size, SectionReader &reader, TileWriter &tiles)
+{
+    read_strokes(data, size, reader, [&](DecodedStroke &stroke) {
+        write_tiled(reader, stroke, tiles);
+    });
+}
+
+void read_raster(const unsigned char *data, size_t size, SectionReader &reader, Raster &raster)
+{
+    read_strokes(data, size, reader, [&](DecodedStroke &stroke) {
+        draw_stroke(stroke, raster);
+    });
+}
+
+bool read_stdin(std::vector<unsigned char> &data)
+{
+    data.clear();
+    size_t size = 0;
+    while (true)
+    {
+        data.resize(std::max<size_t>(size * 2, 1 << 16));
+        size_t n = std::fread(data.data() + size, 1, data.size() - size, stdin);
+        size += n;
+        if (size < data.size())
+        {
+            break;
+        }
+    }
+    data.resize(size);
+    return !std::ferror(stdin);
+}
+
+namespace
+{
+/** inflates the media sections of archive one after the other, and hands each to read.
+ *
+ */
+template <typename Read> void read_sections(WillArchive &archive, ConversionStats *stats, Read read)
+{
+    std::vector<unsigned char> buffer;
+    for (auto &section : archive.sections())
+    {
+        const unsigned char *data;
+        size_t size;
+        bool inflated;
+        {
+            StageTimer timer(stats, ConversionStats::Inflate);
+            inflated = archive.read(section, buffer, data, size);
+        }
+        if (!inflated)
+        {
+            std::cerr << "error reading " << section.name << ": " << archive.error() << std::endl;
+            continue;
+        }
+        if (stats != NULL)
+        {
+            stats->compressed_bytes += section.compressed_size;
+            stats->inflated_bytes += size;
+        }
+        read(data, size);
+    }
+}
+
+/** writes the strokes of all media sections of archive as svg document to sink.
+ *
+ * @param stats receives the stage times and counters, or NULL.
+ * @return false if the document could not be written completely.
+ */
+bool write_svg(WillArchive &archive, std::streambuf *sink, const ConvertOptions &options, ConversionStats *stats)
+{
+    svg::Dimensions dimensions(592.0, 864.0);
+    svg::Layout layout(dimensions, svg::Layout::TopLeft);
+    SectionReader reader(options, layout);
+    reader.stats = stats;
+
+    // The output is only counted if it is measured.
+    std::unique_ptr<CountingBuf> counter;
+    if (stats != NULL)
+    {
+        counter.reset(new CountingBuf(sink, stats->output_bytes));
+        sink = counter.get();
+    }
+
+    svg::StreamingDocument doc(sink, layout);
+    if (!doc.good())
+    {
+        return false;
+    }
+
+    read_sections(archive, stats, [&](const unsigned char *data, size_t size) {
+        read_file(data, size, reader, doc);
+    });
+
+    StageTimer timer(stats, ConversionStats::Finish);
+    return doc.close();
+}
+
+/** renders the strokes of all media sections of archive, and writes them as png to sink.
+ *
+ * The tiles of the image are rendered on as many threads as the strokes are decoded on.
+ *
+ * @param stats receives the stage times and counters, or NULL.
+ * @return false if the png could not be written completely.
+ */
+bool write_raster(WillArchive &archive, std::streambuf *sink, const ConvertOptions &options, ConversionStats *stats)
+{
+    svg::Dimensions dimensions(592.0, 864.0);
+    svg::Layout layout(dimensions, svg::Layout::TopLeft);
+    SectionReader reader(options, layout);
+    reader.stats = stats;
+
+    std::unique_ptr<CountingBuf> counter;
+    if (stats != NULL)
+    {
+        counter.reset(new CountingBuf(sink, stats->output_bytes));
+        sink = counter.get();
+    }
+
+    Raster raster(layout, options.raster_size);
+    read_sections(archive, stats, [&](const unsigned char *data, size_t size) {
+        read_raster(data, size, reader, raster);
+    });
+    {
+        StageTimer timer(stats, ConversionStats::Raster);
+        raster.render(reader.threads);
+    }
+
+    StageTimer timer(stats, ConversionStats::Finish);
+    return raster.write_png(sink, options.compression_level);
+}
+
+/** writes the strokes of all media sections of archive into a directory of tiles.
+ *
+ * @return false if the directory, a tile or the manifest could not be written.
+ */
+bool write_tiles(WillArchive &archive, const std::string &dir, const ConvertOptions &options, ConversionStats *stats)
+{
+    svg::Dimensions dimensions(592.0, 864.0);
+    svg::Layout layout(dimensions, svg::Layout::TopLeft);
+    SectionReader reader(options, layout);
+    reader.stats = stats;
+
+    TileWriter tiles(dir,
+        layout,
+        options.tile_size,
+        options.compress_tiles,
+        options.compression_level,
+        stats != NULL ? &stats->output_bytes : NULL);
+    if (!tiles.open())
+    {
+        return false;
+    }
+
+    read_sections(archive, stats, [&](const unsigned char *data, size_t size) {
+        read_tiles(data, size, reader, tiles);
+    });
+
+    StageTimer timer(stats, ConversionStats::Finish);
+    return tiles.close();
+}
+}
+
+bool convert_file(const std::string &will_file_name, const std::string &svg_file_name, const ConvertOptions &options)
+{
+    // A .will file read from stdin is kept in memory, and both readers work on it in place.
+    bool from_stdin = will_file_name == "-";
+
+    // Streams are never cached. A key that can not be computed only means the file is converted.
+    bool cached = !options.cache_dir.empty() && !from_stdin && svg_file_name != "-" && options.tile_size <= 0;
+    uint64_t key = 0;
+    if (cached)
+    {
+        cached = cache_key(will_file_name, svg_file_name, options, key);
+        if (cached && cache_current(options.cache_dir, svg_file_name, key))
+        {
+            if (options.stats != NULL)
+            {
+                ConversionStats stats;
+                stats.cached_files = 1;
+                options.stats->add(stats);
+            }
+            return true;
+        }
+    }
+    std::vector<unsigned char> input;
+    if (from_stdin && !read_stdin(input))
+    {
+        std::cerr << "error reading will file from stdin" << std::endl;
+        return false;
+    }
+
+    ConversionStats stats;
+    ConversionStats *file_stats = options.stats != NULL ? &stats : NULL;
+    WillArchive archive;
+    bool open;
+    {
+        StageTimer timer(file_stats, ConversionStats::Open);
+        open = from_stdin ? archive.open(input.data(), input.size(), options.mmap, will_file_name)
+                         : archive.open(will_file_name, options.mmap);
+    }
+    if (!open)
+    {
+        return false;
+    }
+
+    if (options.tile_size > 0)
+    {
+        if (!write_tiles(archive, svg_file_name, options, file_stats))
+        {
+            std::cerr << "error writing the tiles of " << svg_file_name << std::endl;
+            return false;
+        }
+        if (options.stats != NULL)
+        {
+            stats.files = 1;
+            options.stats->add(stats);
+        }
+        return true;
+    }
+
+    // The svg file is only created once the archive could be opened.
+    std::vector<char> file_buffer;
+    std::filebuf svg_file;
+    GzipFileBuf gzip_file;
+    std::streambuf *sink = NULL;
+    if (svg_file_name == "-")
+    {
+        sink = std::cout.rdbuf();
+    }
+    else if (is_svgz(svg_file_name))
+    {
+        if (gzip_file.open(svg_file_name, options.compression_level))
+        {
+            sink = &gzip_file;
+        }
+    }
+    else
+    {
+        file_buffer.resize(1 << 16);
+        svg_file.pubsetbuf(file_buffer.data(), file_buffer.size());
+        if (svg_file.open(svg_file_name, std::ios::out | std::ios::trunc))
+        {
+            sink = &svg_file;
+        }
+    }
+    if (sink == NULL)
+    {
+        std::cerr << "error opening " << svg_file_name << std::endl;
+        return false;
+    }
+
+    bool written = options.raster_size > 0 ? write_raster(archive, sink, options, file_stats)
+                                           : write_svg(archive, sink, options, file_stats);
+    {
+        StageTimer timer(file_stats, ConversionStats::Finish);
+        if (sink == &svg_file && svg_file.close() == NULL)
+        {
+            written = false;
+        }
+        if (sink == &gzip_file && !gzip_file.close())
+        {
+            written = false;
+        }
+    }
+    if (!written)
+    {
+        std::cerr << "error writing " << svg_file_name << std::endl;
+        return false;
+    }
+    if (cached && !cache_store(options.cache_dir, svg_file_name, key))
+    {
+        std::cerr << "error recording " << svg_file_name << " in the cache " << options.cache_dir << std::endl;
+    }
+    if (options.stats != NULL)
+    {
+        stats.files = 1;
+        options.stats->add(stats);
+    }
+    return true;
+}
+
+bool convert_to_stream(const std::string &will_file_name,
+    const unsigned char *data,
+    size_t size,
+    std::streambuf *sink,
+    const ConvertOptions &options)
+{
+    ConversionStats stats;
+    ConversionStats *file_stats = options.stats != NULL ? &stats : NULL;
+    WillArchive archive;
+    bool open;
+    {
+        StageTimer timer(file_stats, ConversionStats::Open);
+        open = data != NULL ? archive.open(data, size, options.mmap, will_file_name)
+                            : archive.open(will_file_name, options.mmap);
+    }
+    if (!open)
+    {
+        return false;
+    }
+    bool written = options.raster_size > 0 ? write_raster(archive, sink, options, file_stats)
+                                           : write_svg(archive, sink, options, file_stats);
+    if (!written)
+    {
+        return false;
+    }
+    if (options.stats != NULL)
+    {
+        stats.files = 1;
+        options.stats->add(stats);
+    }
+    return true;
+}
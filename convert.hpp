@@ -0,0 +1,262 @@
+/*
+ * convert.hpp
+ *
+ * Conversion of the media sections of a .will file to svg.
+ */
+
+#ifndef CONVERT_HPP
+#define CONVERT_HPP
+
+#include "outline.hpp"
+#include "raster.hpp"
+#include "simple_svg_1.0.0.hpp"
+#include "simplify.hpp"
+#include "stats.hpp"
+#include "tiles.hpp"
+#include "will_reader.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** scratch space of getPath(), which is reused from stroke to stroke.
+ *
+ * Parsing into the same Path keeps the capacity of its repeated fields, so once the scratch has seen the largest
+ * stroke no more memory is allocated.
+ */
+struct DecodeScratch
+{
+    PathData path;
+    PathParser parser;
+    SimplifyScratch simplify;
+    std::vector<double> widths;
+    OutlineScratch outline;
+    // points decoded with this scratch, which read_file() moves to the stats.
+    uint64_t points = 0;
+};
+
+/** parses the protobuf steam part into scratch.path.
+ *
+ * Uses the built-in decoder, see PathParser.
+ */
+bool parsePath(const unsigned char *data, uint len, DecodeScratch &scratch);
+
+/** gernerates the path out of the protobuf steam part.
+ *
+ * The points of polyline are replaced. Its capacity is kept, so a reused polyline is filled without allocating.
+ */
+void getPath(const unsigned char *data, uint len, DecodeScratch &scratch, svg::Polyline &polyline);
+
+/** decodes the widths of the path last parsed by getPath(), see decode_widths().
+ *
+ */
+void getWidths(const DecodeScratch &scratch, std::vector<double> &widths);
+
+/** reads the color of the path last parsed by getPath(), see decode_color(). The alpha channel is dropped.
+ *
+ * @return false if the path has no color.
+ */
+bool getColor(const DecodeScratch &scratch, svg::Color &color);
+
+/** options of a conversion, which are the same for all files.
+ *
+ */
+struct ConvertOptions
+{
+    // amount of threads used to parse the strokes of a single media section.
+    unsigned int decode_threads = 1;
+    // read the archive from a memory mapping instead of with libzip. A file that is truncated while it is mapped
+    // raises SIGBUS.
+    bool mmap = false;
+    // maximal deviation of a simplified stroke in svg units. 0 keeps all points.
+    double tolerance = 0;
+
+    enum Shape
+    {
+        // absolute points, which any svg reader understands.
+        Polyline,
+        // relative path commands, which are much shorter.
+        Path
+    };
+    // element the strokes are written as.
+    Shape shape = Polyline;
+    // draw the strokes with the widths of the pen. Strokes of variable width are written as filled outlines.
+    bool widths = false;
+    // draw the strokes in the color of the pen instead of black.
+    bool colors = false;
+    // write each distinct style once into a <style> element, and refer to it by class.
+    bool classes = false;
+    // zlib compression level of .svgz files from 0 to 9, or -1 for the default of zlib.
+    int compression_level = -1;
+    // directory of the conversion cache, or empty for none. convert_file() skips files whose svg is still current.
+    std::string cache_dir;
+    // receives the stage times and counters of each conversion, or NULL to not measure them.
+    StatsCollector *stats = NULL;
+    // edge of the square tiles in svg units, or 0 for a single svg. convert_file() writes tiles into a directory.
+    double tile_size = 0;
+    // write the tiles as .svgz with compression_level.
+    bool compress_tiles = false;
+    // longer side of a png in pixels, or 0 for svg. The png is written to the name of the svg, with compression_level.
+    unsigned int raster_size = 0;
+};
+
+/** a stroke of the window of read_file(), ready to be written.
+ *
+ */
+struct DecodedStroke
+{
+    svg::Polyline line;
+    // width of the pen, or -1 for the default width.
+    double width = -1;
+    svg::Color color = svg::Color::Black;
+    // the points of line are the outline of a stroke of variable width, and are filled instead of stroked.
+    bool outline = false;
+};
+
+/** threads that parse the windows of read_file() together with the calling thread.
+ *
+ * The threads are started with the first window that needs them, and then wait for the next window until the file is
+ * done. So a file of many windows and sections starts its threads only once.
+ */
+class DecodeWorkers
+{
+public:
+    DecodeWorkers() = default;
+    DecodeWorkers(const DecodeWorkers &) = delete;
+    DecodeWorkers &operator=(const DecodeWorkers &) = delete;
+    ~DecodeWorkers();
+
+    /** runs task on threads threads, and returns once all of them are done.
+     *
+     * @param task called on each thread with its index. The calling thread has the index 0.
+     */
+    void run(size_t threads, const std::function<void(size_t)> &task);
+
+private:
+    void work(size_t index);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    const std::function<void(size_t)> *task = NULL;
+    // increased with each task, so the workers see that there is a new one.
+    uint64_t generation = 0;
+    // threads that run the current task, and workers of them that are not done yet.
+    size_t participants = 0;
+    size_t pending = 0;
+    bool stopping = false;
+};
+
+/** state of read_file(), which is kept for all sections of a file.
+ *
+ * Frames, scratch spaces, polylines and the decode threads are reused, so in steady state decoding does not allocate
+ * or start threads.
+ */
+struct SectionReader
+{
+    SectionReader(const ConvertOptions &options, const svg::Layout &layout)
+        : threads(std::max(options.decode_threads, 1u)),
+          tolerance(options.tolerance / layout.scale),
+          shape(options.shape),
+          widths(options.widths),
+          colors(options.colors),
+          classes(options.classes),
+          scratch(threads),
+          path(svg::Fill(svg::Color::White), svg::Stroke(1, svg::Color::Black)),
+          outline_polygon(svg::Fill(svg::Color::Black), svg::Stroke()),
+          outline_path(svg::Fill(svg::Color::Black), svg::Stroke())
+    {
+        outline_path.setClosed(true);
+    }
+
+    unsigned int threads;
+    // strokes are simplified to this maximal deviation in user units, see simplify().
+    double tolerance;
+    ConvertOptions::Shape shape;
+    bool widths;
+    bool colors;
+    bool classes;
+    std::vector<Frame> frames;
+    std::vector<DecodeScratch> scratch;
+    std::vector<DecodedStroke> window;
+    // points every line of the window has room for: the longest line so far, rounded up to a power of 2. Otherwise
+    // each slot would grow on its own whenever a longer stroke falls into it.
+    size_t line_capacity = 1;
+    DecodeWorkers workers;
+    // write the strokes of the window, if they are not written as polyline.
+    svg::Path path;
+    svg::Polygon outline_polygon;
+    svg::Path outline_path;
+    // stats of the file, or NULL.
+    ConversionStats *stats = NULL;
+};
+
+/** Reads a protobuf file, and writes the resulting svg lines to doc.
+ *
+ * The file is read in two phases. First the frames are split by their length prefix, which has to be done in
+ * sequence. Afterwards the frames are parsed in windows, each on up to reader.threads threads. Each thread writes to
+ * the slot of its frame, and the window is written before the next one is parsed, so the lines keep the order of the
+ * file.
+ *
+ * @param data the whole, inflated media section.
+ */
+void read_file(const unsigned char *data, size_t size, SectionReader &reader, svg::StreamingDocument &doc);
+
+/** reads a protobuf file like read_file(), and writes each line into the tiles its bounding box overlaps.
+ *
+ * The bounding box of a line of fixed width grows by half the width, so a tile gets every line that reaches into it.
+ */
+void read_tiles(const unsigned char *data, size_t size, SectionReader &reader, TileWriter &tiles);
+
+/** reads a protobuf file like read_file(), and adds the lines to raster to be rendered.
+ *
+ */
+void read_raster(const unsigned char *data, size_t size, SectionReader &reader, Raster &raster);
+
+/** reads all of stdin into data.
+ *
+ * @return false if reading failed.
+ */
+bool read_stdin(std::vector<unsigned char> &data);
+
+/** converts a single .will file to a .svg file.
+ *
+ * If the name of the svg file ends with .svgz, it is gzip compressed while it is written. A name of - reads the .will
+ * file from stdin, or writes the svg to stdout.
+ *
+ * With a cache_dir in the options, a file is skipped if its svg was written by an earlier run from the same content
+ * and options, and was not changed since. Files are cached by content, so a .will file that is only touched is not
+ * converted again.
+ *
+ * With a raster_size in the options, the strokes are rendered and written as png instead, see Raster.
+ *
+ * With a tile_size in the options, svg_file_name is a directory, which receives the tiles of the page and their
+ * manifest, see TileWriter. Tiles are not cached.
+ *
+ * Errors are reported on std::cerr. Nothing in here terminates the process, so a broken archive does not stop a
+ * batch run.
+ *
+ * @return true if the svg was written or is current.
+ */
+bool convert_file(const std::string &will_file_name, const std::string &svg_file_name, const ConvertOptions &options);
+
+/** converts a .will file, and writes the svg, or the png if the options have a raster_size, to sink.
+ *
+ * sink is flushed but not closed.
+ *
+ * @param data the .will file held in memory, which is read in place. If NULL, the file will_file_name is read.
+ * @return true if the svg was written.
+ */
+bool convert_to_stream(const std::string &will_file_name,
+    const unsigned char *data,
+    size_t size,
+    std::streambuf *sink,
+    const ConvertOptions &options);
+
+#endif
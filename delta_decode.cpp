@@ -0,0 +1,133 @@
+/*
+ * delta_decode.cpp
+ *
+ * Kernels to undo the delta encoding of the points of a stroke.
+ */
+
+#include "delta_decode.hpp"
+#include <cstring>
+#include <initializer_list>
+
+#ifdef DELTA_DECODE_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+/** decodes the values from begin on, with x and y being the sums before begin.
+ *
+ */
+void delta_decode_tail(
+    const int32_t *deltas, size_t begin, size_t count, double divisor, double *out, uint32_t x, uint32_t y)
+{
+    size_t i = begin;
+    for (; i + 1 < count; i += 2)
+    {
+        x += deltas[i];
+        y += deltas[i + 1];
+        out[i] = int32_t(x) / divisor;
+        out[i + 1] = int32_t(y) / divisor;
+    }
+    if (i < count)
+    {
+        x += deltas[i];
+        out[i] = int32_t(x) / divisor;
+    }
+}
+}
+
+void delta_decode_scalar(const int32_t *deltas, size_t count, double divisor, double *out)
+{
+    delta_decode_tail(deltas, 0, count, divisor, out, 0, 0);
+}
+
+#ifdef DELTA_DECODE_X86
+
+/** two x/y pairs per step. The 64 bit lanes hold one pair each, so the prefix sum of a step is a single shift.
+ *
+ */
+__attribute__((target("sse2"))) void delta_decode_sse2(
+    const int32_t *deltas, size_t count, double divisor, double *out)
+{
+    const __m128d div = _mm_set1_pd(divisor);
+    __m128i carry = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *) (deltas + i));
+        v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+        v = _mm_add_epi32(v, carry);
+        carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 2, 3, 2));
+
+        _mm_storeu_pd(out + i, _mm_div_pd(_mm_cvtepi32_pd(v), div));
+        _mm_storeu_pd(out + i + 2, _mm_div_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(v, v)), div));
+    }
+
+    int32_t last[4];
+    _mm_storeu_si128((__m128i *) last, carry);
+    delta_decode_tail(deltas, i, count, divisor, out, last[0], last[1]);
+}
+
+/** four x/y pairs per step. The prefix sum is done within the 128 bit lanes first, and the sum of the lower lane
+ * is added to the upper one afterwards.
+ *
+ */
+__attribute__((target("avx2"))) void delta_decode_avx2(
+    const int32_t *deltas, size_t count, double divisor, double *out)
+{
+    const __m256d div = _mm256_set1_pd(divisor);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i carry = zero;
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (deltas + i));
+        v = _mm256_add_epi32(v, _mm256_slli_si256(v, 8));
+        __m256i low_sum = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(1, 1, 0, 0));
+        v = _mm256_add_epi32(v, _mm256_blend_epi32(zero, low_sum, 0xF0));
+        v = _mm256_add_epi32(v, carry);
+        carry = _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 3, 3, 3));
+
+        _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), div));
+        _mm256_storeu_pd(out + i + 4, _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), div));
+    }
+
+    int32_t last[8];
+    _mm256_storeu_si256((__m256i *) last, carry);
+    delta_decode_tail(deltas, i, count, divisor, out, last[0], last[1]);
+}
+
+#endif
+
+DeltaDecodeKernel delta_decode_kernel(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        return delta_decode_scalar;
+    }
+#ifdef DELTA_DECODE_X86
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        return delta_decode_sse2;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        return delta_decode_avx2;
+    }
+#endif
+    return NULL;
+}
+
+DeltaDecodeKernel delta_decode_kernel()
+{
+    for (const char *name : {"avx2", "sse2"})
+    {
+        if (DeltaDecodeKernel kernel = delta_decode_kernel(name))
+        {
+            return kernel;
+        }
+    }
+    return delta_decode_scalar;
+}
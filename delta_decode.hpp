@@ -0,0 +1,50 @@
+/*
+ * delta_decode.hpp
+ *
+ * Kernels to undo the delta encoding of the points of a stroke.
+ */
+
+#ifndef DELTA_DECODE_HPP
+#define DELTA_DECODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/** undoes the delta encoding of interleaved x/y values and scales them to doubles.
+ *
+ * The x values are the even, the y values the odd elements of deltas. Each is the difference to the previous value of
+ * the same axis. out[i] is the sum of the deltas of its axis up to i, divided by divisor. The sums wrap like int32_t.
+ *
+ * @param count amount of int32_t values in deltas and doubles in out.
+ */
+typedef void (*DeltaDecodeKernel)(const int32_t *deltas, size_t count, double divisor, double *out);
+
+void delta_decode_scalar(const int32_t *deltas, size_t count, double divisor, double *out);
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DELTA_DECODE_X86
+void delta_decode_sse2(const int32_t *deltas, size_t count, double divisor, double *out);
+void delta_decode_avx2(const int32_t *deltas, size_t count, double divisor, double *out);
+#endif
+
+/** the name of the kernel is "scalar", "sse2" or "avx2".
+ *
+ * @return the kernel, or NULL if the cpu does not support it.
+ */
+DeltaDecodeKernel delta_decode_kernel(const char *name);
+
+/** the fastest kernel the cpu supports.
+ *
+ */
+DeltaDecodeKernel delta_decode_kernel();
+
+/** undoes the delta encoding with the fastest kernel of the cpu, see DeltaDecodeKernel.
+ *
+ */
+inline void delta_decode(const int32_t *deltas, size_t count, double divisor, double *out)
+{
+    static const DeltaDecodeKernel kernel = delta_decode_kernel();
+    kernel(deltas, count, divisor, out);
+}
+
+#endif
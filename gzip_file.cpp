@@ -0,0 +1,88 @@
+/*
+ * gzip_file.cpp
+ *
+ * Stream buffer that writes a gzip compressed file, for .svgz output.
+ */
+
+#include "gzip_file.hpp"
+
+GzipFileBuf::GzipFileBuf(size_t buffer_size) : file(NULL), buffer(buffer_size), failed(false)
+{
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+GzipFileBuf::~GzipFileBuf()
+{
+    close();
+}
+
+bool GzipFileBuf::open(const std::string &file_name, int level)
+{
+    close();
+    std::string mode = "wb";
+    if (level >= 0 && level <= 9)
+    {
+        mode += char('0' + level);
+    }
+    file = gzopen(file_name.c_str(), mode.c_str());
+    if (file == NULL)
+    {
+        return false;
+    }
+    // With buffers of the same size, zlib deflates each full put area directly instead of copying it.
+    gzbuffer(file, buffer.size());
+    failed = false;
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return true;
+}
+
+bool GzipFileBuf::close()
+{
+    if (file == NULL)
+    {
+        return false;
+    }
+    flush_buffer();
+    if (gzclose(file) != Z_OK)
+    {
+        failed = true;
+    }
+    file = NULL;
+    return !failed;
+}
+
+bool GzipFileBuf::flush_buffer()
+{
+    size_t size = pptr() - pbase();
+    if (size > 0 && (file == NULL || gzwrite(file, pbase(), size) != int(size)))
+    {
+        failed = true;
+    }
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return !failed;
+}
+
+int GzipFileBuf::overflow(int c)
+{
+    if (!flush_buffer())
+    {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int GzipFileBuf::sync()
+{
+    // Only hands the data to zlib. A gzflush() would end the deflate block and cost compression.
+    return flush_buffer() ? 0 : -1;
+}
+
+bool is_svgz(const std::string &file_name)
+{
+    return file_name.size() > 5 && file_name.compare(file_name.size() - 5, 5, ".svgz") == 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * gzip_file.hpp
+ *
+ * Stream buffer that writes a gzip compressed file, for .svgz output.
+ */
+
+#ifndef GZIP_FILE_HPP
+#define GZIP_FILE_HPP
+
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+/** a stream buffer, that deflates everything written to it into a gzip file.
+ *
+ * The data is compressed as it is written, in blocks of the size of the buffer, so no uncompressed copy is kept in
+ * memory or on disk.
+ */
+class GzipFileBuf : public std::streambuf
+{
+public:
+    GzipFileBuf(size_t buffer_size = 1 << 16);
+    GzipFileBuf(const GzipFileBuf &) = delete;
+    GzipFileBuf &operator=(const GzipFileBuf &) = delete;
+    ~GzipFileBuf();
+
+    /** creates or truncates the file.
+     *
+     * @param level the zlib compression level from 0 to 9, or -1 for the default of zlib.
+     * @return false if the file could not be opened.
+     */
+    bool open(const std::string &file_name, int level = Z_DEFAULT_COMPRESSION);
+
+    /** writes the rest of the data and the gzip trailer.
+     *
+     * @return false if the file was not open or any write failed.
+     */
+    bool close();
+
+protected:
+    int overflow(int c) override;
+    int sync() override;
+
+private:
+    bool flush_buffer();
+
+    gzFile file;
+    std::vector<char> buffer;
+    bool failed;
+};
+
+/** true if the name ends with .svgz, which is written gzip compressed.
+ *
+ */
+bool is_svgz(const std::string &file_name);
+
+#endif
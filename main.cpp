@@ -5,130 +5,452 @@
  *      Author: andreas
  */
 
-#include "simple_svg_1.0.0.hpp"
+#include "convert.hpp"
+#include "server.hpp"
+#include "watch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
 #include <fstream>
-#include <iomanip>
+#include <getopt.h>
 #include <iostream>
+#include <mutex>
+#include <signal.h>
 #include <string>
+#include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <vector>
-#include <will.pb.h>
-#include <zip.h>
 
-/** parse the length of the following protobuf stuff
+void print_help(char *program_name)
+{
+    std::cerr << "Usage: " << std::string(program_name)
+              << " -i input_filename [-o output_filename] [-t decode_threads] [-m] [-e tolerance] [-f polyline|path]"
+              << " [-w] [-c] [-s] [-z level] [-K cache_directory] [-T tile_size] [-P size]"
+              << " [--stats|--stats-json]\n"
+              << "       " << std::string(program_name)
+              << " [-j workers] [-t decode_threads] [-m] [-e tolerance] [-f polyline|path] [-w]"
+              << " [-c] [-s] [-z level] [-K cache_directory] [-T tile_size] [-P size] [-o output_directory]"
+              << " [-l list_filename] [input ...]\n"
+              << "       " << std::string(program_name)
+              << " -S socket [-j workers] [-t decode_threads] [-m] [-e tolerance] [-f polyline|path] [-w] [-c] [-s]\n"
+              << "       " << std::string(program_name) << " -C socket -i input_filename [-o output_filename]\n"
+              << "       " << std::string(program_name)
+              << " -C socket [-z level] [-o output_directory] [-l list_filename] [input ...]\n"
+              << "       " << std::string(program_name)
+              << " -W directory [-j workers] [-t decode_threads] [-e tolerance] [-f polyline|path] [-w] [-c] [-s]"
+              << " [-z level] [-K cache_directory] [-T tile_size] [-P size] [-o output_directory]\n"
+              << "With -T the page is written as tiles of tile_size svg units into the directory name_tiles, see the"
+              << " README.\n"
+              << "With -P the page is rendered as png, size pixels on the longer side.\n"
+              << "Any mode that converts in this process prints statistics to stderr with --stats or --stats-json.\n";
+}
+
+bool has_will_suffix(const std::string &file_name)
+{
+    return file_name.size() > 5 && file_name.compare(file_name.size() - 5, 5, ".will") == 0;
+}
+
+/** derives the name of the svg file from the name of the .will file.
  *
- * This function reads 128 bit (16 Byte) and calculates the length of the following protobuf section.
- * It sets the file pointer to the end of the parsed number.
+ * The .will suffix is replaced by extension. If there is no .will suffix, extension is appended.
  *
- * @param file handle to the file to read.
+ * @param extension .svg, .svgz, .png or _tiles for a directory of tiles
+ */
+std::string svg_name_for(const std::string &will_file_name, const std::string &extension)
+{
+    if (!has_will_suffix(will_file_name))
+    {
+        std::cerr << "not a .will file! Will append " << extension << std::endl;
+        return will_file_name + extension;
+    }
+    return will_file_name.substr(0, will_file_name.size() - 5) + extension;
+}
+
+/** a .will file of a batch.
  *
  */
-uint64_t getLength(zip_file_t *file)
+struct Input
 {
-    unsigned char data;
-    data = 0x0;
+    std::string file_name;
+    // path below the directory the file was found in, or the name of the file without directory if it was given
+    // directly.
+    std::string relative_name;
+};
 
-    uint64_t len = 0;
-    for (size_t i = 0; i < 16; i++)
+/** derives the name of the output of a batch or watched file.
+ *
+ * With an output_dir, the output keeps the path relative_name has below it, so files of the same name in different
+ * subdirectories do not overwrite each other.
+ */
+std::string output_name_for(const std::string &will_file_name,
+    const std::string &relative_name,
+    const std::string &output_dir,
+    const std::string &extension)
+{
+    if (output_dir == "")
     {
-        zip_fread(file, (char *) &data, 1);
-        len |= (data & 127) << (7 * i);
-        // If the next-byte flag is set
-        if (!(data & 128))
+        return svg_name_for(will_file_name, extension);
+    }
+    return output_dir + "/" + svg_name_for(relative_name, extension);
+}
+
+/** creates the directories of relative_name below output_dir, which has to exist.
+ *
+ * @return false if one of them could not be created.
+ */
+bool make_output_directories(const std::string &output_dir, const std::string &relative_name)
+{
+    for (size_t slash = relative_name.find('/'); slash != std::string::npos; slash = relative_name.find('/', slash + 1))
+    {
+        std::string dir = output_dir + "/" + relative_name.substr(0, slash);
+        if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
         {
-            break;
+            std::cerr << "error creating output directory " << dir << ": " << std::strerror(errno) << std::endl;
+            return false;
         }
     }
-
-    return len;
+    return true;
 }
 
-/** reads n chars from the file file, and returns a char array with the read data.
+/** parses an integer argument, which has to be a number as a whole.
  *
- * @param file file handle to the file
- * @param len amount of chars to read.
+ * @return false if text is no number, or the number is outside of min to max.
+ */
+bool parse_integer(const char *text, long min, long max, long &value)
+{
+    char *end;
+    errno = 0;
+    value = std::strtol(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+/** parses a decimal argument like parse_integer().
  *
+ * @return false if text is no finite number, or the number is below min.
  */
-unsigned char *getData(zip_file_t *file, int len)
+bool parse_decimal(const char *text, double min, double &value)
 {
-    unsigned char *buff = (unsigned char *) calloc(sizeof(char), len);
-    zip_fread(file, (char *) buff, len);
-    return buff;
+    char *end;
+    errno = 0;
+    value = std::strtod(text, &end);
+    return end != text && *end == '\0' && errno == 0 && std::isfinite(value) && value >= min;
 }
 
-/** gernerates the path out of the protobuf steam part.
+bool is_directory(const std::string &path)
+{
+    struct stat path_stat;
+    return stat(path.c_str(), &path_stat) == 0 && S_ISDIR(path_stat.st_mode);
+}
+
+/** adds all .will files below the directory dir_name to inputs.
  *
+ * @param relative_dir path of dir_name below the directory given as input, or empty for that directory.
  */
-svg::Polyline getPath(unsigned char *data, uint len)
+void collect_directory(const std::string &dir_name, const std::string &relative_dir, std::vector<Input> &inputs)
 {
-    WacomInkFormat::Path path;
+    DIR *dir = opendir(dir_name.c_str());
+    if (dir == NULL)
+    {
+        std::cerr << "error opening directory " << dir_name << std::endl;
+        return;
+    }
 
-    svg::Polyline polyline(svg::Fill(svg::Color::White), svg::Stroke(1, svg::Color::Black));
+    std::vector<std::string> names;
+    while (struct dirent *entry = readdir(dir))
+    {
+        std::string name(entry->d_name);
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        names.push_back(name);
+    }
+    closedir(dir);
 
-    svg::Point(0, 0);
-    if (!path.ParseFromArray(data, len))
+    std::sort(names.begin(), names.end());
+    for (auto &name : names)
     {
-        std::cerr << "Failed to parse will." << std::endl;
+        std::string path = dir_name + "/" + name;
+        std::string relative_name = relative_dir == "" ? name : relative_dir + "/" + name;
+        if (is_directory(path))
+        {
+            collect_directory(path, relative_name, inputs);
+        }
+        else if (has_will_suffix(name))
+        {
+            inputs.push_back(Input{path, relative_name});
+        }
     }
-    double dp = 0;
-    dp = path.decimalprecision();
+}
 
-    if (path.points_size() > 0)
+/** adds an input given on the command line or in a list file. Directories are expanded to the .will files they
+ * contain.
+ *
+ */
+void add_input(const std::string &input, std::vector<Input> &inputs)
+{
+    if (input.empty())
     {
-        std::vector<int32_t> integer_values(path.points_size(), 0);
+        return;
+    }
+    if (is_directory(input))
+    {
+        collect_directory(input, "", inputs);
+    }
+    else
+    {
+        inputs.push_back(Input{input, input.substr(input.rfind('/') + 1)});
+    }
+}
 
-        integer_values[0] = path.points(0);
-        integer_values[1] = path.points(1);
-        for (int i = 2; i < path.points_size(); i += 2)
+/** pairs each input with the name of its output, see output_name_for(), and creates the directories of the outputs.
+ *
+ * An input whose output is already taken by an earlier input is reported as failed and left out, so no two
+ * conversions write the same file.
+ *
+ * @return amount of inputs left out.
+ */
+size_t plan_jobs(const std::vector<Input> &inputs,
+    const std::string &output_dir,
+    const std::string &extension,
+    std::vector<std::pair<std::string, std::string>> &jobs)
+{
+    size_t failed = 0;
+    std::unordered_map<std::string, std::string> inputs_by_output;
+    for (auto &input : inputs)
+    {
+        std::string output = output_name_for(input.file_name, input.relative_name, output_dir, extension);
+        auto taken = inputs_by_output.emplace(output, input.file_name);
+        bool ok = taken.second;
+        if (!ok)
+        {
+            std::cerr << "error converting " << input.file_name << ": " << output << " is already the output of "
+                      << taken.first->second << std::endl;
+        }
+        else if (output_dir != "")
+        {
+            ok = make_output_directories(output_dir, input.relative_name);
+        }
+        if (ok)
         {
-            integer_values[i] = integer_values[i - 2] + path.points(i);
-            integer_values[i + 1] = integer_values[i - 1] + path.points(i + 1);
+            jobs.emplace_back(input.file_name, output);
         }
+        else
+        {
+            std::cout << "failed " << input.file_name << std::endl;
+            failed++;
+        }
+    }
+    return failed;
+}
+
+/** converts all jobs on a pool of worker threads.
+ *
+ * Each worker picks the next unconverted file until all are done. The result of each file is reported on
+ * std::cout.
+ *
+ * @param jobs pairs of the .will file and the svg file it is converted to, see plan_jobs().
+ * @return amount of files, that failed to convert.
+ */
+size_t convert_batch(
+    const std::vector<std::pair<std::string, std::string>> &jobs, unsigned int workers, const ConvertOptions &options)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> failed(0);
+    std::mutex report_mutex;
 
-        for (int i = 0; i < path.points_size(); i += 2)
+    auto worker = [&]() {
+        for (size_t n = next++; n < jobs.size(); n = next++)
         {
-            polyline << svg::Point(integer_values[i] / std::pow(10.0, dp), integer_values[i + 1] / std::pow(10.0, dp));
+            const std::string &will_file_name = jobs[n].first;
+            const std::string &svg_file_name = jobs[n].second;
+
+            bool ok = false;
+            try
+            {
+                ok = convert_file(will_file_name, svg_file_name, options);
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "error converting " << will_file_name << ": " << e.what() << std::endl;
+            }
+
+            if (!ok)
+            {
+                failed++;
+            }
+            std::lock_guard<std::mutex> lock(report_mutex);
+            if (ok)
+            {
+                std::cout << "ok " << will_file_name << " -> " << svg_file_name << std::endl;
+            }
+            else
+            {
+                std::cout << "failed " << will_file_name << std::endl;
+            }
         }
+    };
+
+    if (workers > jobs.size())
+    {
+        workers = jobs.size();
+    }
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < workers; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads)
+    {
+        thread.join();
     }
 
-    return polyline;
+    return failed;
 }
 
-void print_help(char *program_name)
+StatsCollector collected_stats;
+bool stats_as_json = false;
+
+/** prints the stats of all conversions of the process, when it exits.
+ *
+ */
+void print_stats()
+{
+    if (stats_as_json)
+    {
+        collected_stats.print_json(std::cerr);
+    }
+    else
+    {
+        collected_stats.print(std::cerr);
+    }
+}
+
+ConversionServer *running_server = NULL;
+DirectoryWatcher *running_watcher = NULL;
+
+void stop_server(int)
+{
+    if (running_server != NULL)
+    {
+        running_server->stop();
+    }
+    if (running_watcher != NULL)
+    {
+        running_watcher->stop();
+    }
+}
+
+void stop_on_signals()
 {
-    std::cerr << "Usage: " << std::string(program_name) << " -i input_filename [-o output_filename]\n";
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_server;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
 }
 
-/** Reads a protobuf file, and returns resulting svg line.
+/** serves conversions on socket_path until the process gets SIGINT or SIGTERM.
  *
  */
-std::vector<svg::Polyline> read_file(const svg::Document &doc, zip_file_t *file)
+int serve(const std::string &socket_path, unsigned int workers, const ConvertOptions &options)
 {
-    unsigned char *data;
-    std::vector<svg::Polyline> lines;
-    while (true)
+    ConversionServer server(options, workers);
+    if (!server.listen(socket_path))
     {
-        auto len = getLength(file);
-        if (len == 0)
-        {
-            break;
-        }
-        data = getData(file, len);
-        lines.push_back(getPath(data, len));
-        free(data);
+        return EXIT_FAILURE;
+    }
+
+    running_server = &server;
+    stop_on_signals();
+
+    std::cerr << "listening on " << socket_path << std::endl;
+    server.run();
+    running_server = NULL;
+    return EXIT_SUCCESS;
+}
+
+/** converts the .will files, that are written into dir, until the process gets SIGINT or SIGTERM.
+ *
+ * The result of each file is reported on std::cout, like in the batch mode.
+ */
+int watch(const std::string &dir,
+    const std::string &output_dir,
+    const std::string &extension,
+    unsigned int workers,
+    const ConvertOptions &options)
+{
+    std::mutex report_mutex;
+    DirectoryWatcher watcher(
+        [&](const std::string &will_file_name) {
+            // Below the output directory, the files keep their path below the watched one.
+            std::string relative_name = will_file_name.compare(0, dir.size() + 1, dir + "/") == 0
+                ? will_file_name.substr(dir.size() + 1)
+                : will_file_name.substr(will_file_name.rfind('/') + 1);
+            std::string svg_file_name = output_name_for(will_file_name, relative_name, output_dir, extension);
+            bool ok = (output_dir == "" || make_output_directories(output_dir, relative_name))
+                && convert_file(will_file_name, svg_file_name, options);
+
+            std::lock_guard<std::mutex> lock(report_mutex);
+            if (ok)
+            {
+                std::cout << "ok " << will_file_name << " -> " << svg_file_name << std::endl;
+            }
+            else
+            {
+                std::cout << "failed " << will_file_name << std::endl;
+            }
+        },
+        workers);
+    if (!watcher.watch(dir))
+    {
+        return EXIT_FAILURE;
     }
-    return lines;
+
+    running_watcher = &watcher;
+    stop_on_signals();
+
+    std::cerr << "watching " << dir << std::endl;
+    watcher.run();
+    running_watcher = NULL;
+    return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[])
 {
     int opt;
+    long number;
 
     std::string will_file_name;
     std::string svg_file_name;
+    std::string list_file_name;
+    std::string extension = ".svg";
+    std::string serve_socket;
+    std::string client_socket;
+    std::string watch_dir;
+    unsigned int workers = std::thread::hardware_concurrency();
+    unsigned int decode_threads = 0;
+    ConvertOptions options;
+
+    enum
+    {
+        StatsOption = 256,
+        StatsJsonOption
+    };
+    const struct option long_options[] = {
+        {"stats", no_argument, NULL, StatsOption},
+        {"stats-json", no_argument, NULL, StatsJsonOption},
+        {NULL, 0, NULL, 0},
+    };
 
-    while ((opt = getopt(argc, argv, "i:o:")) != -1)
+    while ((opt = getopt_long(argc, argv, "i:o:j:l:t:me:f:wcsz:K:T:P:S:C:W:", long_options, NULL)) != -1)
     {
         switch (opt)
         {
@@ -138,104 +460,267 @@ int main(int argc, char *argv[])
         case 'o':
             svg_file_name = std::string(optarg);
             break;
-        default: /* '?' */
-            print_help(argv[0]);
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    if (will_file_name == "")
-    {
-        print_help(argv[0]);
-        exit(EXIT_FAILURE);
-    }
-
-    GOOGLE_PROTOBUF_VERIFY_VERSION;
-
-    int error;
-    zip_t *will_file = zip_open(will_file_name.c_str(), ZIP_RDONLY, &error);
-
-    if (will_file == NULL)
-    {
-        std::cerr << "error opening will file. Libzip says: " << error << ":";
-        switch (error)
-        {
-        case ZIP_ER_EXISTS:
-            std::cerr << "ZIP_ER_EXISTS" << std::endl;
+        case 'j':
+            if (!parse_integer(optarg, 1, 4096, number))
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            workers = number;
             break;
-        case ZIP_ER_INCONS:
-            std::cerr << "ZIP_ER_INCONS" << std::endl;
+        case 'l':
+            list_file_name = std::string(optarg);
             break;
-        case ZIP_ER_INVAL:
-            std::cerr << "ZIP_ER_INVAL" << std::endl;
+        case 't':
+            if (!parse_integer(optarg, 1, 4096, number))
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            decode_threads = number;
             break;
-        case ZIP_ER_MEMORY:
-            std::cerr << "ZIP_ER_MEMORY" << std::endl;
+        case 'm':
+            options.mmap = true;
             break;
-        case ZIP_ER_NOENT:
-            std::cerr << "ZIP_ER_NOENT" << std::endl;
+        case 'e':
+            if (!parse_decimal(optarg, 0, options.tolerance))
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
             break;
-        case ZIP_ER_NOZIP:
-            std::cerr << "ZIP_ER_NOZIP" << std::endl;
+        case 'f':
+            if (std::string(optarg) == "path")
+            {
+                options.shape = ConvertOptions::Path;
+            }
+            else if (std::string(optarg) == "polyline")
+            {
+                options.shape = ConvertOptions::Polyline;
+            }
+            else
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'w':
+            options.widths = true;
+            break;
+        case 'c':
+            options.colors = true;
+            break;
+        case 's':
+            options.classes = true;
+            break;
+        case 'z':
+            if (!parse_integer(optarg, 0, 9, number))
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            options.compression_level = number;
+            extension = ".svgz";
+            break;
+        case 'K':
+            options.cache_dir = std::string(optarg);
+            break;
+        case 'T':
+            if (!parse_decimal(optarg, 0, options.tile_size) || options.tile_size == 0)
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            if (!parse_integer(optarg, 16, 16384, number))
+            {
+                print_help(argv[0]);
+                exit(EXIT_FAILURE);
+            }
+            options.raster_size = number;
             break;
-        case ZIP_ER_OPEN:
-            std::cerr << "ZIP_ER_OPEN" << std::endl;
+        case 'S':
+            serve_socket = std::string(optarg);
             break;
-        case ZIP_ER_READ:
-            std::cerr << "ZIP_ER_READ" << std::endl;
+        case 'C':
+            client_socket = std::string(optarg);
             break;
-        case ZIP_ER_SEEK:
-            std::cerr << "ZIP_ER_SEEK" << std::endl;
+        case 'W':
+            watch_dir = std::string(optarg);
             break;
-        default:
-            std::cerr << std::endl;
+        case StatsOption:
+        case StatsJsonOption:
+            stats_as_json = opt == StatsJsonOption;
+            options.stats = &collected_stats;
             break;
+        default: /* '?' */
+            print_help(argv[0]);
+            exit(EXIT_FAILURE);
         }
-        exit(EXIT_FAILURE);
     }
 
-    if (svg_file_name == "")
+    bool batch = optind < argc || list_file_name != "";
+
+    if (options.raster_size > 0)
     {
-        size_t file_name_length = will_file_name.find(".will");
-        if (file_name_length == std::string::npos)
+        if (serve_socket != "" || client_socket != "" || options.tile_size > 0)
         {
-            std::cerr << "not a .will file! Will append .svg" << std::endl;
-            svg_file_name = will_file_name + ".svg";
+            std::cerr << "-P can not be combined with -S, -C or -T" << std::endl;
+            exit(EXIT_FAILURE);
         }
-        else
+        // -z only sets the compression of the png.
+        extension = ".png";
+    }
+    if (options.tile_size > 0)
+    {
+        if (serve_socket != "" || client_socket != "")
+        {
+            std::cerr << "-T is not supported by the server" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        // The tiles of each file go into a directory, and -z compresses each tile.
+        options.compress_tiles = extension == ".svgz";
+        extension = "_tiles";
+    }
+
+    if (options.cache_dir != "")
+    {
+        if (mkdir(options.cache_dir.c_str(), 0777) != 0 && errno != EEXIST)
+        {
+            std::cerr << "error creating cache directory " << options.cache_dir << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (!is_directory(options.cache_dir))
         {
-            svg_file_name = will_file_name.substr(0, file_name_length);
-            svg_file_name += ".svg";
+            std::cerr << "cache " << options.cache_dir << " is not a directory" << std::endl;
+            exit(EXIT_FAILURE);
         }
     }
 
-    zip_uint64_t i = 0;
-    zip_stat_t file_stat;
+    if (options.stats != NULL && client_socket == "")
+    {
+        std::atexit(print_stats);
+    }
 
-    svg::Dimensions dimensions(592.0, 864.0);
-    svg::Document doc(svg_file_name, svg::Layout(dimensions, svg::Layout::TopLeft));
+    if (serve_socket != "")
+    {
+        // the requests already keep all workers busy
+        options.decode_threads = decode_threads == 0 ? 1 : decode_threads;
+        exit(serve(serve_socket, workers == 0 ? 1 : workers, options));
+    }
 
-    while (zip_stat_index(will_file, i, 0, &file_stat) == 0)
+    if (watch_dir != "")
     {
-        std::string file_name(file_stat.name);
-        if (file_name.find(".protobuf") != std::string::npos && file_name.find("sections/media") != std::string::npos)
+        if (svg_file_name != "" && !is_directory(svg_file_name))
+        {
+            std::cerr << "output " << svg_file_name << " is not a directory" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        // watched files are often rewritten while they are converted, which would end the process with SIGBUS
+        if (options.mmap)
         {
-            zip_file_t *file = zip_fopen_index(will_file, i, 0);
-            if (file != NULL)
+            std::cerr << "-m is not supported with -W, the files are read without a memory mapping" << std::endl;
+            options.mmap = false;
+        }
+        // the workers already keep all cores busy
+        options.decode_threads = decode_threads == 0 ? 1 : decode_threads;
+        exit(watch(watch_dir, svg_file_name, extension, workers == 0 ? 1 : workers, options));
+    }
+
+    if (will_file_name == "" && !batch)
+    {
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch)
+    {
+        std::vector<Input> inputs;
+        add_input(will_file_name, inputs);
+        for (int i = optind; i < argc; i++)
+        {
+            add_input(argv[i], inputs);
+        }
+        if (list_file_name != "")
+        {
+            std::ifstream list_file;
+            if (list_file_name != "-")
             {
-                auto lines = read_file(doc, file);
-                for (auto &line : lines)
+                list_file.open(list_file_name);
+                if (!list_file.good())
                 {
-                    doc << line;
+                    std::cerr << "error opening list file " << list_file_name << std::endl;
+                    exit(EXIT_FAILURE);
                 }
             }
-            else
+            std::istream &list = list_file_name == "-" ? std::cin : list_file;
+            std::string line;
+            while (std::getline(list, line))
             {
-                std::cerr << "error opening " << file_name << std::endl;
+                add_input(line, inputs);
             }
         }
-        i++;
+        if (svg_file_name != "" && !is_directory(svg_file_name))
+        {
+            std::cerr << "output " << svg_file_name << " is not a directory" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (workers == 0)
+        {
+            workers = 1;
+        }
+        if (decode_threads == 0)
+        {
+            // the workers already keep all cores busy
+            decode_threads = 1;
+        }
+        options.decode_threads = decode_threads;
+
+        std::vector<std::pair<std::string, std::string>> jobs;
+        size_t failed = plan_jobs(inputs, svg_file_name, extension, jobs);
+        if (client_socket != "")
+        {
+            failed += convert_remote(client_socket, jobs, options.compression_level, true);
+        }
+        else
+        {
+            failed += convert_batch(jobs, workers, options);
+        }
+        std::cerr << inputs.size() - failed << " of " << inputs.size() << " files converted" << std::endl;
+        exit(failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (svg_file_name == "")
+    {
+        // An svg read from stdin has no name to derive one from, so it goes on to stdout.
+        svg_file_name = will_file_name == "-" ? "-" : svg_name_for(will_file_name, extension);
+    }
+    if (svg_file_name == "-" && extension == ".svgz")
+    {
+        std::cerr << "-z needs an output file, compress stdout with gzip instead" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (svg_file_name == "-" && options.tile_size > 0)
+    {
+        std::cerr << "-T needs an output directory" << std::endl;
+        exit(EXIT_FAILURE);
     }
 
-    doc.save();
+    if (client_socket != "")
+    {
+        std::vector<std::pair<std::string, std::string>> jobs{{will_file_name, svg_file_name}};
+        exit(convert_remote(client_socket, jobs, options.compression_level, false) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    if (decode_threads == 0)
+    {
+        decode_threads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    options.decode_threads = decode_threads;
+
+    if (!convert_file(will_file_name, svg_file_name, options))
+    {
+        exit(EXIT_FAILURE);
+    }
 }
@@ -0,0 +1,103 @@
+/*
+ * outline.cpp
+ *
+ * Outlines of strokes of variable width.
+ */
+
+#include "outline.hpp"
+#include <algorithm>
+#include <cmath>
+
+void outline(std::vector<svg::Point> &points, const std::vector<double> &widths, OutlineScratch &scratch)
+{
+    if (points.empty() || points.size() != widths.size())
+    {
+        return;
+    }
+
+    size_t size = points.size();
+    scratch.x.resize(size);
+    scratch.y.resize(size);
+    scratch.half_width.resize(size);
+    scratch.normal_x.resize(size);
+    scratch.normal_y.resize(size);
+    scratch.offset_x.resize(size);
+    scratch.offset_y.resize(size);
+    double *__restrict x = scratch.x.data();
+    double *__restrict y = scratch.y.data();
+    double *__restrict half_width = scratch.half_width.data();
+    double *__restrict normal_x = scratch.normal_x.data();
+    double *__restrict normal_y = scratch.normal_y.data();
+    double *__restrict offset_x = scratch.offset_x.data();
+    double *__restrict offset_y = scratch.offset_y.data();
+
+    // A repeated point has no direction. It is merged into its predecessor.
+    size_t n = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        double half = std::max(widths[i], 0.0) / 2;
+        if (n > 0 && points[i].x == x[n - 1] && points[i].y == y[n - 1])
+        {
+            half_width[n - 1] = std::max(half_width[n - 1], half);
+            continue;
+        }
+        x[n] = points[i].x;
+        y[n] = points[i].y;
+        half_width[n] = half;
+        n++;
+    }
+
+    if (n == 1)
+    {
+        double half = half_width[0];
+        points.resize(4);
+        points[0] = svg::Point(x[0], y[0] - half);
+        points[1] = svg::Point(x[0] + half, y[0]);
+        points[2] = svg::Point(x[0], y[0] + half);
+        points[3] = svg::Point(x[0] - half, y[0]);
+        return;
+    }
+
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+        double dx = x[i + 1] - x[i];
+        double dy = y[i + 1] - y[i];
+        double inverse_length = 1 / std::sqrt(dx * dx + dy * dy);
+        normal_x[i] = -dy * inverse_length;
+        normal_y[i] = dx * inverse_length;
+    }
+
+    offset_x[0] = normal_x[0] * half_width[0];
+    offset_y[0] = normal_y[0] * half_width[0];
+    for (size_t i = 1; i + 1 < n; i++)
+    {
+        // The offset 2 h / |b|^2 * b along the bisector b of the normals is h away from both segments. For corners
+        // sharper than 120 degrees |b|^2 drops below 1, and the offset is limited to 2 h.
+        double bisector_x = normal_x[i - 1] + normal_x[i];
+        double bisector_y = normal_y[i - 1] + normal_y[i];
+        double length2 = bisector_x * bisector_x + bisector_y * bisector_y;
+        double scale = 2 * half_width[i] / (length2 > 1 ? length2 : 1);
+        offset_x[i] = bisector_x * scale;
+        offset_y[i] = bisector_y * scale;
+    }
+    offset_x[n - 1] = normal_x[n - 2] * half_width[n - 1];
+    offset_y[n - 1] = normal_y[n - 2] * half_width[n - 1];
+
+    points.resize(2 * n + 2);
+    svg::Point *__restrict out = points.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i].x = x[i] + offset_x[i];
+        out[i].y = y[i] + offset_y[i];
+    }
+    // The caps point along the direction of the first and the last segment, which is the normal turned right.
+    out[n].x = x[n - 1] + normal_y[n - 2] * half_width[n - 1];
+    out[n].y = y[n - 1] - normal_x[n - 2] * half_width[n - 1];
+    for (size_t i = 0; i < n; i++)
+    {
+        out[n + 1 + i].x = x[n - 1 - i] - offset_x[n - 1 - i];
+        out[n + 1 + i].y = y[n - 1 - i] - offset_y[n - 1 - i];
+    }
+    out[2 * n + 1].x = x[0] - normal_y[0] * half_width[0];
+    out[2 * n + 1].y = y[0] + normal_x[0] * half_width[0];
+}
@@ -0,0 +1,43 @@
+/*
+ * outline.hpp
+ *
+ * Outlines of strokes of variable width.
+ */
+
+#ifndef OUTLINE_HPP
+#define OUTLINE_HPP
+
+#include "simple_svg_1.0.0.hpp"
+#include <vector>
+
+/** scratch space of outline(), which is reused from stroke to stroke.
+ *
+ * The coordinates are kept as separate arrays, so the loops over them are vectorized by the compiler.
+ */
+struct OutlineScratch
+{
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> half_width;
+    // unit normals of the segments.
+    std::vector<double> normal_x;
+    std::vector<double> normal_y;
+    // offsets of the points to the left side of the outline.
+    std::vector<double> offset_x;
+    std::vector<double> offset_y;
+};
+
+/** replaces the center line of a stroke by the outline of the stroke drawn with its widths.
+ *
+ * The outline is a single polygon. It runs along the left side of the stroke, around a pointed cap at the end, back
+ * along the right side and around a pointed cap at the start. At each point the sides are offset by half its width
+ * along the bisector of the adjacent segments. The offset of a sharp corner is limited to the width, so turns of the
+ * pen do not spike out of the stroke.
+ *
+ * Points which repeat their predecessor are dropped. A stroke of a single point becomes a diamond of its width.
+ *
+ * @param widths one width for each point. If the sizes differ, points is left as it is.
+ */
+void outline(std::vector<svg::Point> &points, const std::vector<double> &widths, OutlineScratch &scratch);
+
+#endif
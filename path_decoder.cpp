@@ -0,0 +1,282 @@
+/*
+ * path_decoder.cpp
+ *
+ * Decoder for the WacomInkFormat::Path messages of will.proto, which does not need libprotobuf.
+ */
+
+#include "path_decoder.hpp"
+#include <cstring>
+
+namespace
+{
+enum WireType
+{
+    VARINT = 0,
+    FIXED64 = 1,
+    LENGTH_DELIMITED = 2,
+    START_GROUP = 3,
+    END_GROUP = 4,
+    FIXED32 = 5
+};
+
+// groups nested deeper than the recursion limit of libprotobuf are rejected like it does.
+const unsigned int max_group_depth = 100;
+
+/** reads a varint at pos and moves pos behind it.
+ *
+ * @return false if the varint is longer than 10 bytes or exceeds end.
+ */
+inline bool read_varint(const unsigned char *&pos, const unsigned char *end, uint64_t &value)
+{
+    // Most values of a stroke are small deltas, which fit into one byte.
+    if (pos < end && *pos < 128)
+    {
+        value = *pos++;
+        return true;
+    }
+
+    value = 0;
+    for (unsigned int shift = 0; shift < 70 && pos < end; shift += 7)
+    {
+        unsigned char byte = *pos++;
+        value |= uint64_t(byte & 127) << shift;
+        if (!(byte & 128))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** reads a tag at pos like libprotobuf does: it has at most 5 bytes, and bits beyond 32 are dropped.
+ *
+ */
+inline bool read_tag(const unsigned char *&pos, const unsigned char *end, uint32_t &tag)
+{
+    if (pos < end && *pos < 128)
+    {
+        tag = *pos++;
+        return true;
+    }
+
+    tag = 0;
+    for (unsigned int shift = 0; shift < 35 && pos < end; shift += 7)
+    {
+        unsigned char byte = *pos++;
+        tag |= uint32_t(byte & 127) << shift;
+        if (!(byte & 128))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline int32_t zigzag_decode(uint32_t value)
+{
+    return int32_t((value >> 1) ^ (~(value & 1) + 1));
+}
+
+inline float read_float(const unsigned char *pos)
+{
+    uint32_t bits = uint32_t(pos[0]) | uint32_t(pos[1]) << 8 | uint32_t(pos[2]) << 16 | uint32_t(pos[3]) << 24;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/** decodes a packed sint32 field and appends the values to values.
+ *
+ */
+bool read_packed_sint32(const unsigned char *pos, const unsigned char *end, std::vector<int32_t> &values)
+{
+    // Each value takes at least one byte, so values is grown once and shrunk to the decoded size afterwards.
+    size_t size = values.size();
+    values.resize(size + (end - pos));
+    int32_t *out = values.data() + size;
+
+    while (pos < end)
+    {
+        uint32_t value;
+        // The deltas of a stroke mostly fit into one or two bytes.
+        if (pos[0] < 128)
+        {
+            value = pos[0];
+            pos += 1;
+        }
+        else if (end - pos >= 2 && pos[1] < 128)
+        {
+            value = (pos[0] & 127) | uint32_t(pos[1]) << 7;
+            pos += 2;
+        }
+        else
+        {
+            uint64_t long_value;
+            if (!read_varint(pos, end, long_value))
+            {
+                values.resize(out - values.data());
+                return false;
+            }
+            value = uint32_t(long_value);
+        }
+        *out++ = zigzag_decode(value);
+    }
+    values.resize(out - values.data());
+    return true;
+}
+
+bool skip_group(const unsigned char *&pos, const unsigned char *end, uint32_t field, unsigned int depth);
+
+/** skips the value of an unknown field.
+ *
+ * @param depth of the groups the field is in.
+ */
+bool skip_field(const unsigned char *&pos, const unsigned char *end, uint32_t tag, unsigned int depth)
+{
+    uint64_t value;
+    switch (tag & 7)
+    {
+    case VARINT:
+        return read_varint(pos, end, value);
+    case FIXED64:
+        if (end - pos < 8)
+        {
+            return false;
+        }
+        pos += 8;
+        return true;
+    case LENGTH_DELIMITED:
+        if (!read_varint(pos, end, value) || value > uint64_t(end - pos))
+        {
+            return false;
+        }
+        pos += value;
+        return true;
+    case FIXED32:
+        if (end - pos < 4)
+        {
+            return false;
+        }
+        pos += 4;
+        return true;
+    case START_GROUP:
+        return skip_group(pos, end, tag >> 3, depth + 1);
+    default:
+        // an end group without a start, or an invalid wire type
+        return false;
+    }
+}
+
+/** skips the fields of a group, up to the end group tag of its field.
+ *
+ * will.proto has no groups, but an unknown field may be one.
+ */
+bool skip_group(const unsigned char *&pos, const unsigned char *end, uint32_t field, unsigned int depth)
+{
+    if (depth > max_group_depth)
+    {
+        return false;
+    }
+    while (pos < end)
+    {
+        uint32_t tag;
+        if (!read_tag(pos, end, tag) || tag >> 3 == 0)
+        {
+            return false;
+        }
+        if ((tag & 7) == END_GROUP)
+        {
+            return tag >> 3 == field;
+        }
+        if (!skip_field(pos, end, tag, depth))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+std::vector<int32_t> *repeated_field(PathData &path, uint32_t field)
+{
+    switch (field)
+    {
+    case 4:
+        return &path.points;
+    case 5:
+        return &path.stroke_width;
+    case 6:
+        return &path.stroke_color;
+    default:
+        return NULL;
+    }
+}
+}
+
+bool decode_path(const unsigned char *data, size_t len, PathData &path)
+{
+    path.clear();
+
+    const unsigned char *pos = data;
+    const unsigned char *end = data + len;
+    while (pos < end)
+    {
+        uint32_t tag;
+        if (!read_tag(pos, end, tag))
+        {
+            return false;
+        }
+        uint32_t field = tag >> 3;
+        uint32_t wire_type = tag & 7;
+        if (field == 0)
+        {
+            return false;
+        }
+
+        std::vector<int32_t> *values = repeated_field(path, field);
+        if ((field == 1 || field == 2) && wire_type == FIXED32)
+        {
+            if (end - pos < 4)
+            {
+                return false;
+            }
+            (field == 1 ? path.start_parameter : path.end_parameter) = read_float(pos);
+            pos += 4;
+        }
+        else if (field == 3 && wire_type == VARINT)
+        {
+            uint64_t value;
+            if (!read_varint(pos, end, value))
+            {
+                return false;
+            }
+            path.decimal_precision = uint32_t(value);
+        }
+        else if (values != NULL && wire_type == LENGTH_DELIMITED)
+        {
+            uint64_t size;
+            if (!read_varint(pos, end, size) || size > uint64_t(end - pos))
+            {
+                return false;
+            }
+            if (!read_packed_sint32(pos, pos + size, *values))
+            {
+                return false;
+            }
+            pos += size;
+        }
+        else if (values != NULL && wire_type == VARINT)
+        {
+            uint64_t value;
+            if (!read_varint(pos, end, value))
+            {
+                return false;
+            }
+            values->push_back(zigzag_decode(uint32_t(value)));
+        }
+        else if (!skip_field(pos, end, tag, 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+/*
+ * path_decoder.hpp
+ *
+ * Decoder for the WacomInkFormat::Path messages of will.proto, which does not need libprotobuf.
+ */
+
+#ifndef PATH_DECODER_HPP
+#define PATH_DECODER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/** the fields of a WacomInkFormat::Path.
+ *
+ * The repeated fields keep their capacity when a PathData is decoded again.
+ */
+struct PathData
+{
+    float start_parameter = 0;
+    float end_parameter = 1;
+    uint32_t decimal_precision = 2;
+    std::vector<int32_t> points;
+    std::vector<int32_t> stroke_width;
+    std::vector<int32_t> stroke_color;
+
+    /** sets all fields to their defaults, keeping the capacity of the repeated fields.
+     *
+     */
+    void clear()
+    {
+        start_parameter = 0;
+        end_parameter = 1;
+        decimal_precision = 2;
+        points.clear();
+        stroke_width.clear();
+        stroke_color.clear();
+    }
+};
+
+/** decodes a serialized WacomInkFormat::Path into path.
+ *
+ * Follows the protobuf wire format like the generated code does: scalars keep the last value, repeated fields
+ * are accepted packed and unpacked, and unknown fields are skipped, groups included. path_decoder_test.cpp checks
+ * that it agrees with libprotobuf.
+ *
+ * @return false if data is not a valid message. path holds the fields decoded so far.
+ */
+bool decode_path(const unsigned char *data, size_t len, PathData &path);
+
+#endif
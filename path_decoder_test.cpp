@@ -0,0 +1,443 @@
+/*
+ * path_decoder_test.cpp
+ *
+ * Checks decode_path() against the parser libprotobuf generates from will.proto. Both get the same generated, mutated
+ * and truncated messages, and have to agree on whether a message is valid, and on every field of a valid one.
+ */
+
+#include "path_decoder.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <will.pb.h>
+
+namespace
+{
+// messages of each kind that are generated, each of which is also truncated and mutated.
+const size_t messages_per_kind = 3000;
+// failures that are printed in full.
+const size_t max_reported = 20;
+
+enum WireType
+{
+    VARINT = 0,
+    FIXED64 = 1,
+    LENGTH_DELIMITED = 2,
+    START_GROUP = 3,
+    END_GROUP = 4,
+    FIXED32 = 5
+};
+
+void append_varint(std::string &out, uint64_t value)
+{
+    while (value >= 128)
+    {
+        out += char(value | 128);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+void append_tag(std::string &out, uint32_t field, WireType wire_type)
+{
+    append_varint(out, uint64_t(field) << 3 | wire_type);
+}
+
+void append_fixed(std::string &out, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++)
+    {
+        out += char(value >> (8 * i));
+    }
+}
+
+uint32_t zigzag_encode(int32_t value)
+{
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+std::string to_hex(const std::string &bytes)
+{
+    std::ostringstream out;
+    out << std::hex << std::setfill('0');
+    for (unsigned char byte : bytes)
+    {
+        out << std::setw(2) << int(byte) << ' ';
+    }
+    return out.str();
+}
+
+bool same_float(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+template <typename Repeated> bool same_values(const std::vector<int32_t> &values, const Repeated &expected)
+{
+    return values.size() == size_t(expected.size()) && std::equal(values.begin(), values.end(), expected.begin());
+}
+
+/** decodes messages with both decoders and counts the disagreements.
+ *
+ */
+class Checker
+{
+public:
+    void check(const std::string &kind, const std::string &message)
+    {
+        checks++;
+        bool expected_ok = expected.ParseFromArray(message.data(), int(message.size()));
+        // path is reused like the scratch of the conversion, so left overs of the last message would show.
+        bool ok = decode_path((const unsigned char *) message.data(), message.size(), path);
+        std::string difference;
+        if (ok != expected_ok)
+        {
+            difference = expected_ok ? "rejected a valid message" : "accepted an invalid message";
+        }
+        else if (ok && !same_float(path.start_parameter, expected.startparameter()))
+        {
+            difference = "startParameter differs";
+        }
+        else if (ok && !same_float(path.end_parameter, expected.endparameter()))
+        {
+            difference = "endParameter differs";
+        }
+        else if (ok && path.decimal_precision != expected.decimalprecision())
+        {
+            difference = "decimalPrecision differs";
+        }
+        else if (ok && !same_values(path.points, expected.points()))
+        {
+            difference = "points differ";
+        }
+        else if (ok && !same_values(path.stroke_width, expected.strokewidth()))
+        {
+            difference = "strokeWidth differs";
+        }
+        else if (ok && !same_values(path.stroke_color, expected.strokecolor()))
+        {
+            difference = "strokeColor differs";
+        }
+        if (difference.empty())
+        {
+            return;
+        }
+        if (failures++ < max_reported)
+        {
+            std::cerr << kind << ": decode_path() " << difference << ": " << to_hex(message) << std::endl;
+        }
+    }
+
+    size_t checks = 0;
+    size_t failures = 0;
+
+private:
+    WacomInkFormat::Path expected;
+    PathData path;
+};
+
+/** generates messages in all the encodings the wire format allows.
+ *
+ */
+class Generator
+{
+public:
+    explicit Generator(uint32_t seed) : random(seed)
+    {
+    }
+
+    /** a random Path, serialized by libprotobuf.
+     *
+     */
+    std::string serialized()
+    {
+        WacomInkFormat::Path message;
+        if (chance(2))
+        {
+            message.set_startparameter(any_float());
+        }
+        if (chance(2))
+        {
+            message.set_endparameter(any_float());
+        }
+        if (chance(2))
+        {
+            message.set_decimalprecision(uint32_t(any_int()));
+        }
+        for (size_t i = 0, count = length(); i < count; i++)
+        {
+            message.add_points(any_int());
+        }
+        for (size_t i = 0, count = length(); i < count; i++)
+        {
+            message.add_strokewidth(any_int());
+        }
+        for (size_t i = 0, count = length() % 5; i < count; i++)
+        {
+            message.add_strokecolor(any_int());
+        }
+        return message.SerializeAsString();
+    }
+
+    /** a message written field by field: the known fields in the order and encoding chance picks, packed or not,
+     *  repeated scalars, known fields with the wrong wire type, and unknown fields of every wire type.
+     *
+     * @param groups also writes groups, for unknown fields and with the numbers of known fields.
+     */
+    std::string handwritten(bool groups)
+    {
+        std::string message;
+        for (size_t i = 0, count = length() % 12; i < count; i++)
+        {
+            append_field(message, groups, 0);
+        }
+        return message;
+    }
+
+    /** message with random bytes overwritten, inserted or removed.
+     *
+     */
+    std::string mutated(std::string message)
+    {
+        for (size_t i = 0, count = 1 + random() % 3; i < count; i++)
+        {
+            size_t pos = message.empty() ? 0 : random() % message.size();
+            switch (random() % 4)
+            {
+            case 0:
+                message.insert(message.begin() + pos, char(random()));
+                break;
+            case 1:
+                if (!message.empty())
+                {
+                    message.erase(pos, 1);
+                }
+                break;
+            case 2:
+                if (!message.empty())
+                {
+                    message[pos] = char(random());
+                }
+                break;
+            default:
+                // a continuation bit makes the varints run into the next byte
+                if (!message.empty())
+                {
+                    message[pos] = char(message[pos] ^ 0x80);
+                }
+                break;
+            }
+        }
+        return message;
+    }
+
+private:
+    bool chance(uint32_t one_in)
+    {
+        return random() % one_in == 0;
+    }
+
+    size_t length()
+    {
+        return chance(4) ? 0 : random() % 40;
+    }
+
+    int32_t any_int()
+    {
+        switch (random() % 4)
+        {
+        case 0:
+            return int32_t(random() % 256) - 128;
+        case 1:
+            return chance(2) ? std::numeric_limits<int32_t>::min() : std::numeric_limits<int32_t>::max();
+        default:
+            return int32_t(random());
+        }
+    }
+
+    float any_float()
+    {
+        uint32_t bits = uint32_t(random());
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    uint32_t unknown_field()
+    {
+        switch (random() % 3)
+        {
+        case 0:
+            return 7 + random() % 20;
+        case 1:
+            return (1u << 29) - 1;
+        default:
+            return 1 + random() % ((1u << 29) - 1);
+        }
+    }
+
+    void append_field(std::string &message, bool groups, size_t depth)
+    {
+        uint32_t field = chance(3) ? unknown_field() : 1 + random() % 6;
+        uint32_t choice = random() % (groups ? 6 : 5);
+        if (choice == 5 && depth < 4)
+        {
+            // a group, which may hold any fields, even those of the message
+            append_tag(message, field, START_GROUP);
+            for (size_t i = 0, count = random() % 4; i < count; i++)
+            {
+                append_field(message, groups, depth + 1);
+            }
+            append_tag(message, field, END_GROUP);
+        }
+        else if (choice == 0 || (field >= 4 && field <= 6 && choice == 1))
+        {
+            // a varint, or an unpacked element of a repeated field, in any length a varint may have
+            if (field >= 4 && field <= 6)
+            {
+                append_varint(message, uint64_t(field) << 3 | VARINT);
+                append_varint(message, chance(4) ? random() * uint64_t(random()) : zigzag_encode(any_int()));
+            }
+            else
+            {
+                append_tag(message, field, VARINT);
+                append_varint(message, chance(2) ? uint32_t(any_int()) : random() * uint64_t(random()));
+            }
+        }
+        else if (choice == 2 || (field <= 2 && choice == 1))
+        {
+            append_tag(message, field, FIXED32);
+            append_fixed(message, random(), 4);
+        }
+        else if (choice == 3)
+        {
+            append_tag(message, field, FIXED64);
+            append_fixed(message, random() * uint64_t(random()), 8);
+        }
+        else
+        {
+            // length delimited: the packed elements of a repeated field, or any bytes
+            std::string content;
+            for (size_t i = 0, count = length(); i < count; i++)
+            {
+                if (field >= 4 && field <= 6)
+                {
+                    append_varint(content, zigzag_encode(any_int()));
+                }
+                else
+                {
+                    content += char(random());
+                }
+            }
+            append_tag(message, field, LENGTH_DELIMITED);
+            append_varint(message, content.size());
+            message += content;
+        }
+    }
+
+    std::mt19937 random;
+};
+
+/** messages at the limits of the wire format, which the generator may not hit.
+ *
+ */
+std::vector<std::string> edge_cases()
+{
+    std::vector<std::string> messages = {
+        // empty message
+        std::string(),
+        // field number 0
+        std::string("\x00\x01", 2),
+        std::string("\x05\x00\x00\x00\x00", 5),
+        // wire types 6 and 7
+        std::string("\x0e\x00", 2),
+        std::string("\x0f\x00", 2),
+        // an end group without a start, and a group that is not closed or closed with another number
+        std::string("\x3c", 1),
+        std::string("\x3b\x18\x01", 3),
+        std::string("\x3b\x18\x01\x44", 4),
+        std::string("\x3b\x18\x01\x3c", 4),
+        // a field number 0 and an end group of field 0 in a group
+        std::string("\x3b\x05\x00\x00\x00\x00\x3c", 7),
+        std::string("\x3b\x04", 2),
+        // decimalPrecision as varints of 1, 5, 10 and 11 bytes
+        std::string("\x18\x05", 2),
+        std::string("\x18\xff\xff\xff\xff\x0f", 6),
+        std::string("\x18\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 11),
+        std::string("\x18\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 12),
+        // a tag with redundant bytes, and tags of 5 and 6 bytes
+        std::string("\x98\x00\x05", 3),
+        std::string("\x98\x80\x80\x80\x00\x05", 6),
+        std::string("\x98\x80\x80\x80\x80\x00\x05", 7),
+        std::string("\xf8\xff\xff\xff\x0f\x05", 6),
+        std::string("\xf8\xff\xff\xff\x1f\x05", 6),
+        // packed points with a varint that runs past the field, and a length past the message
+        std::string("\x22\x02\x02\x80\x01", 5),
+        std::string("\x22\x05\x02\x04", 4),
+        // an empty packed field, and a packed field with an element of 10 bytes
+        std::string("\x22\x00", 2),
+        std::string("\x22\x0a\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 12),
+        // a length delimited field with a length of 2^32 + 1
+        std::string("\x3a\x81\x80\x80\x80\x10\x00", 7),
+    };
+    // groups nested up to the recursion limit of libprotobuf, and beyond
+    for (size_t depth : {99, 100, 101})
+    {
+        std::string message;
+        for (size_t i = 0; i < depth; i++)
+        {
+            append_tag(message, 7, START_GROUP);
+        }
+        for (size_t i = 0; i < depth; i++)
+        {
+            append_tag(message, 7, END_GROUP);
+        }
+        messages.push_back(message);
+    }
+    return messages;
+}
+}
+
+int main()
+{
+    GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+    Checker checker;
+    Generator generator(1);
+
+    // each message, with all its prefixes and a few mutations
+    auto check_all = [&](const std::string &kind, const std::string &message) {
+        checker.check(kind, message);
+        for (size_t size = 0; size < message.size(); size++)
+        {
+            checker.check(kind + ", truncated", message.substr(0, size));
+        }
+        for (size_t i = 0; i < 10; i++)
+        {
+            checker.check(kind + ", mutated", generator.mutated(message));
+        }
+    };
+
+    for (auto &message : edge_cases())
+    {
+        check_all("edge case", message);
+    }
+    for (size_t i = 0; i < messages_per_kind; i++)
+    {
+        check_all("serialized", generator.serialized());
+        check_all("handwritten", generator.handwritten(false));
+        check_all("handwritten with groups", generator.handwritten(true));
+    }
+
+    std::cout << checker.checks << " messages, " << checker.failures << " disagreements" << std::endl;
+    google::protobuf::ShutdownProtobufLibrary();
+    return checker.failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
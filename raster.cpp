@@ -0,0 +1,497 @@
+/*
+ * raster.cpp
+ *
+ * Anti-aliased rasterizer of the strokes, for png thumbnails without a round trip through svg.
+ */
+
+#include "raster.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <zlib.h>
+
+struct Raster::Scratch
+{
+    // coverage of the current shape, from 0 to 1.
+    std::vector<float> coverage = std::vector<float>(tile_size * tile_size);
+    // signed area of the edges of the current outline. Rows have two more cells, which take the area right of the
+    // tile.
+    std::vector<float> area = std::vector<float>((tile_size + 2) * tile_size);
+    // red, green and blue of the tile, from 0 to 1.
+    std::vector<float> color = std::vector<float>(tile_size * tile_size * 3);
+    // the pixels of each row the current shape touched. A stroke covers only a thin band of its bounding box, so only
+    // the spans are blended.
+    std::vector<uint32_t> span_begin = std::vector<uint32_t>(tile_size, tile_size);
+    std::vector<uint32_t> span_end = std::vector<uint32_t>(tile_size, 0);
+};
+
+namespace
+{
+/** adds the signed area an edge covers in each pixel to the rows of area.
+ *
+ * The cover of a pixel is the sum of the cells up to it, so the cells only hold the change from pixel to pixel. The
+ * edge has to lie within x from 0 to width.
+ */
+void accumulate_edge(float *area, size_t stride, size_t height, float ax, float ay, float bx, float by)
+{
+    if (ay == by)
+    {
+        return;
+    }
+    float direction = 1;
+    if (ay > by)
+    {
+        std::swap(ax, bx);
+        std::swap(ay, by);
+        direction = -1;
+    }
+    if (by <= 0 || ay >= height)
+    {
+        return;
+    }
+    float dxdy = (bx - ax) / (by - ay);
+    float right = stride - 2;
+    float x = ax;
+    if (ay < 0)
+    {
+        x = std::min(std::max(x - ay * dxdy, 0.0f), right);
+    }
+    size_t y_end = std::min(height, size_t(std::ceil(by)));
+    for (size_t y = ay < 0 ? 0 : size_t(ay); y < y_end; y++)
+    {
+        float *line = area + y * stride;
+        float dy = std::min(float(y + 1), by) - std::max(float(y), ay);
+        // Rounding must not walk the edge out of the row.
+        float x_next = std::min(std::max(x + dxdy * dy, 0.0f), right);
+        float d = dy * direction;
+        float x0 = std::min(x, x_next);
+        float x1 = std::max(x, x_next);
+        float x0_floor = std::floor(x0);
+        int x0i = int(x0_floor);
+        float x1_ceil = std::ceil(x1);
+        int x1i = int(x1_ceil);
+        if (x1i <= x0i + 1)
+        {
+            // within a single pixel
+            float middle = 0.5f * (x + x_next) - x0_floor;
+            line[x0i] += d - d * middle;
+            line[x0i + 1] += d * middle;
+        }
+        else
+        {
+            // The area over the pixels is a trapezoid, with triangles in the first and the last pixel.
+            float s = 1 / (x1 - x0);
+            float x0_fraction = x0 - x0_floor;
+            float a0 = 0.5f * s * (1 - x0_fraction) * (1 - x0_fraction);
+            float x1_fraction = x1 - x1_ceil + 1;
+            float a_last = 0.5f * s * x1_fraction * x1_fraction;
+            line[x0i] += d * a0;
+            if (x1i == x0i + 2)
+            {
+                line[x0i + 1] += d * (1 - a0 - a_last);
+            }
+            else
+            {
+                float a1 = s * (1.5f - x0_fraction);
+                line[x0i + 1] += d * (a1 - a0);
+                for (int xi = x0i + 2; xi < x1i - 1; xi++)
+                {
+                    line[xi] += d * s;
+                }
+                float a2 = a1 + (x1i - x0i - 3) * s;
+                line[x1i - 1] += d * (1 - a2 - a_last);
+            }
+            line[x1i] += d * a_last;
+        }
+        x = x_next;
+    }
+}
+
+/** adds an edge like accumulate_edge(), which can reach beyond the sides of the tile.
+ *
+ * The parts left and right of the tile are moved onto its sides. This keeps the cover they add to the pixels right
+ * of them.
+ */
+void clip_edge(float *area, size_t stride, size_t width, size_t height, float ax, float ay, float bx, float by)
+{
+    float w = width;
+    float splits[4] = {0, 1, 1, 1};
+    size_t count = 1;
+    if ((ax < 0) != (bx < 0))
+    {
+        splits[count++] = -ax / (bx - ax);
+    }
+    if ((ax > w) != (bx > w))
+    {
+        splits[count++] = (w - ax) / (bx - ax);
+    }
+    std::sort(splits, splits + count);
+    splits[count] = 1;
+
+    float x = std::min(std::max(ax, 0.0f), w);
+    float y = ay;
+    for (size_t i = 1; i <= count; i++)
+    {
+        float x_next = i == count ? bx : ax + (bx - ax) * splits[i];
+        float y_next = i == count ? by : ay + (by - ay) * splits[i];
+        x_next = std::min(std::max(x_next, 0.0f), w);
+        accumulate_edge(area, stride, height, x, y, x_next, y_next);
+        x = x_next;
+        y = y_next;
+    }
+}
+
+bool write_chunk(std::streambuf *sink, const char *type, const unsigned char *data, size_t size)
+{
+    unsigned char length[4] = {
+        (unsigned char) (size >> 24), (unsigned char) (size >> 16), (unsigned char) (size >> 8), (unsigned char) size};
+    uLong crc = crc32(0, (const Bytef *) type, 4);
+    if (size > 0)
+    {
+        crc = crc32(crc, data, size);
+    }
+    unsigned char checksum[4] = {
+        (unsigned char) (crc >> 24), (unsigned char) (crc >> 16), (unsigned char) (crc >> 8), (unsigned char) crc};
+    return sink->sputn((const char *) length, 4) == 4 && sink->sputn(type, 4) == 4
+        && sink->sputn((const char *) data, size) == std::streamsize(size)
+        && sink->sputn((const char *) checksum, 4) == 4;
+}
+}
+
+Raster::Raster(const svg::Layout &layout, unsigned int size) : layout(layout)
+{
+    double page = std::max(layout.dimensions.width, layout.dimensions.height);
+    scale = size / page;
+    width_ = std::max(1.0, std::round(layout.dimensions.width * scale));
+    height_ = std::max(1.0, std::round(layout.dimensions.height * scale));
+    columns = (width_ + tile_size - 1) / tile_size;
+    rows = (height_ + tile_size - 1) / tile_size;
+}
+
+void Raster::add_line(const std::vector<svg::Point> &points, double width, const svg::Color &color)
+{
+    float radius = width * scale / 2;
+    add_shape(points, std::max(radius, 0.5f), std::min(2 * radius, 1.0f), color);
+}
+
+void Raster::add_outline(const std::vector<svg::Point> &points, const svg::Color &color)
+{
+    add_shape(points, 0, 1, color);
+}
+
+void Raster::add_shape(const std::vector<svg::Point> &points, float radius, float alpha, const svg::Color &color)
+{
+    if (points.empty())
+    {
+        return;
+    }
+    Shape shape;
+    shape.first = this->points.size() / 2;
+    shape.count = points.size();
+    shape.radius = radius;
+    shape.alpha = alpha;
+    shape.red = color.getRed() / 255.0f;
+    shape.green = color.getGreen() / 255.0f;
+    shape.blue = color.getBlue() / 255.0f;
+    shape.min_x = shape.min_y = INFINITY;
+    shape.max_x = shape.max_y = -INFINITY;
+    for (auto &point : points)
+    {
+        float x = svg::translateX(point.x, layout) * scale;
+        float y = svg::translateY(point.y, layout) * scale;
+        this->points.push_back(x);
+        this->points.push_back(y);
+        shape.min_x = std::min(shape.min_x, x);
+        shape.min_y = std::min(shape.min_y, y);
+        shape.max_x = std::max(shape.max_x, x);
+        shape.max_y = std::max(shape.max_y, y);
+    }
+    // The anti-aliased edge of a line reaches half a pixel beyond its width.
+    float margin = radius > 0 ? radius + 0.5f : 0;
+    shape.min_x -= margin;
+    shape.min_y -= margin;
+    shape.max_x += margin;
+    shape.max_y += margin;
+    if (shape.max_x <= 0 || shape.max_y <= 0 || shape.min_x >= width_ || shape.min_y >= height_)
+    {
+        this->points.resize(shape.first * 2);
+        return;
+    }
+    shapes.push_back(shape);
+}
+
+void Raster::render(unsigned int threads)
+{
+    // The shapes of each tile, in the order they were added.
+    std::vector<std::vector<uint32_t>> tiles(columns * rows);
+    for (size_t i = 0; i < shapes.size(); i++)
+    {
+        const Shape &shape = shapes[i];
+        auto cell = [](float value, size_t count) {
+            return size_t(std::min(std::max(std::floor(value / tile_size), 0.0f), float(count - 1)));
+        };
+        for (size_t row = cell(shape.min_y, rows); row <= cell(shape.max_y, rows); row++)
+        {
+            for (size_t column = cell(shape.min_x, columns); column <= cell(shape.max_x, columns); column++)
+            {
+                tiles[row * columns + column].push_back(i);
+            }
+        }
+    }
+
+    pixels_.resize(width_ * height_ * 3);
+    std::atomic<size_t> next_tile(0);
+    auto render_tiles = [&]() {
+        Scratch scratch;
+        for (size_t tile = next_tile++; tile < tiles.size(); tile = next_tile++)
+        {
+            render_tile(tile % columns, tile / columns, tiles[tile], scratch);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min<size_t>(std::max(threads, 1u), tiles.size()); i++)
+    {
+        workers.emplace_back(render_tiles);
+    }
+    render_tiles();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void Raster::render_tile(size_t column, size_t row, const std::vector<uint32_t> &shapes, Scratch &scratch)
+{
+    size_t x0 = column * tile_size;
+    size_t y0 = row * tile_size;
+    size_t width = std::min(tile_size, width_ - x0);
+    size_t height = std::min(tile_size, height_ - y0);
+    std::fill(scratch.color.begin(), scratch.color.end(), 1.0f);
+
+    for (uint32_t index : shapes)
+    {
+        const Shape &shape = this->shapes[index];
+        if (shape.radius > 0)
+        {
+            draw_line(shape, x0, y0, scratch);
+        }
+        else
+        {
+            fill_outline(shape, x0, y0, scratch);
+        }
+
+        // Blends the coverage of the shape over the tile, and clears it for the next shape.
+        size_t begin_y = std::max(std::floor(shape.min_y) - y0, 0.0f);
+        size_t end_y = std::min(std::ceil(shape.max_y) - y0, float(height));
+        for (size_t y = begin_y; y < end_y; y++)
+        {
+            size_t begin_x = scratch.span_begin[y];
+            size_t end_x = scratch.span_end[y];
+            scratch.span_begin[y] = tile_size;
+            scratch.span_end[y] = 0;
+            for (size_t x = begin_x; x < end_x; x++)
+            {
+                float &coverage = scratch.coverage[y * tile_size + x];
+                float opacity = coverage * shape.alpha;
+                float *color = &scratch.color[(y * tile_size + x) * 3];
+                color[0] += (shape.red - color[0]) * opacity;
+                color[1] += (shape.green - color[1]) * opacity;
+                color[2] += (shape.blue - color[2]) * opacity;
+                coverage = 0;
+            }
+        }
+    }
+
+    for (size_t y = 0; y < height; y++)
+    {
+        uint8_t *pixel = &pixels_[((y0 + y) * width_ + x0) * 3];
+        const float *color = &scratch.color[y * tile_size * 3];
+        for (size_t i = 0; i < width * 3; i++)
+        {
+            pixel[i] = uint8_t(color[i] * 255 + 0.5f);
+        }
+    }
+}
+
+void Raster::draw_line(const Shape &shape, size_t x0, size_t y0, Scratch &scratch) const
+{
+    size_t width = std::min(tile_size, width_ - x0);
+    size_t height = std::min(tile_size, height_ - y0);
+    float reach = shape.radius + 0.5f;
+    float reach_squared = reach * reach;
+    const float *p = &points[shape.first * 2];
+    // A single point is drawn as a segment of length 0, which is a dot.
+    size_t segments = std::max<size_t>(shape.count - 1, 1);
+    for (size_t i = 0; i < segments; i++)
+    {
+        const float *b = shape.count > 1 ? p + 2 : p;
+        float ax = p[0] - x0;
+        float ay = p[1] - y0;
+        float dx = b[0] - p[0];
+        float dy = b[1] - p[1];
+        p += 2;
+
+        float low_x = std::min(ax, ax + dx) - reach;
+        float low_y = std::min(ay, ay + dy) - reach;
+        float high_x = std::max(ax, ax + dx) + reach;
+        float high_y = std::max(ay, ay + dy) + reach;
+        if (high_x <= 0 || high_y <= 0 || low_x >= width || low_y >= height)
+        {
+            continue;
+        }
+        size_t begin_x = std::max(std::floor(low_x), 0.0f);
+        size_t begin_y = std::max(std::floor(low_y), 0.0f);
+        size_t end_x = std::min(std::ceil(high_x), float(width));
+        size_t end_y = std::min(std::ceil(high_y), float(height));
+
+        // The coverage falls off over a pixel at the distance of the radius from the segment. The segments of a line
+        // overlap at its joints, so each pixel keeps its largest coverage instead of adding them.
+        float length = dx * dx + dy * dy;
+        float inverse_length = length > 0 ? 1 / length : 0;
+        for (size_t y = begin_y; y < end_y; y++)
+        {
+            scratch.span_begin[y] = std::min<uint32_t>(scratch.span_begin[y], begin_x);
+            scratch.span_end[y] = std::max<uint32_t>(scratch.span_end[y], end_x);
+            float py = y + 0.5f - ay;
+            float *coverage = &scratch.coverage[y * tile_size];
+            for (size_t x = begin_x; x < end_x; x++)
+            {
+                float px = x + 0.5f - ax;
+                float t = std::min(std::max((px * dx + py * dy) * inverse_length, 0.0f), 1.0f);
+                float ex = px - t * dx;
+                float ey = py - t * dy;
+                float distance = ex * ex + ey * ey;
+                // Most pixels of the box of a slanted segment are out of reach, and need no square root.
+                if (distance < reach_squared)
+                {
+                    float value = reach - std::sqrt(distance);
+                    coverage[x] = std::max(coverage[x], std::min(value, 1.0f));
+                }
+            }
+        }
+    }
+}
+
+void Raster::fill_outline(const Shape &shape, size_t x0, size_t y0, Scratch &scratch) const
+{
+    size_t width = std::min(tile_size, width_ - x0);
+    size_t height = std::min(tile_size, height_ - y0);
+    const size_t stride = width + 2;
+    const float *p = &points[shape.first * 2];
+    for (size_t i = 0; i < shape.count; i++)
+    {
+        // The outline is closed from its last point to the first.
+        size_t j = i + 1 == shape.count ? 0 : i + 1;
+        clip_edge(scratch.area.data(),
+            stride,
+            width,
+            height,
+            p[2 * i] - x0,
+            p[2 * i + 1] - y0,
+            p[2 * j] - x0,
+            p[2 * j + 1] - y0);
+    }
+
+    // Edges above or below the tile add nothing, so only the rows of the outline have to be summed and cleared. The
+    // coverage is only set within the box of the outline, whose rows are the spans render_tile() blends.
+    size_t begin_x = std::max(std::floor(shape.min_x) - x0, 0.0f);
+    size_t begin_y = std::max(std::floor(shape.min_y) - y0, 0.0f);
+    size_t end_x = std::min(std::ceil(shape.max_x) - x0, float(width));
+    size_t end_y = std::min(std::ceil(shape.max_y) - y0, float(height));
+    for (size_t y = begin_y; y < end_y; y++)
+    {
+        float *area = &scratch.area[y * stride];
+        float *coverage = &scratch.coverage[y * tile_size];
+        // The sum of the cells is the winding number, which is filled where it is not zero.
+        float winding = 0;
+        scratch.span_begin[y] = begin_x;
+        scratch.span_end[y] = end_x;
+        for (size_t x = 0; x < end_x; x++)
+        {
+            winding += area[x];
+            if (x >= begin_x)
+            {
+                coverage[x] = std::min(std::abs(winding), 1.0f);
+            }
+        }
+        std::fill(area, area + stride, 0.0f);
+    }
+}
+
+bool Raster::write_png(std::streambuf *sink, int compression_level) const
+{
+    return ::write_png(sink, pixels_.data(), width_, height_, compression_level);
+}
+
+bool write_png(std::streambuf *sink, const uint8_t *pixels, size_t width, size_t height, int compression_level)
+{
+    static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    // 8 bit RGB, deflate, filter method 0, no interlace
+    unsigned char header[13] = {(unsigned char) (width >> 24),
+        (unsigned char) (width >> 16),
+        (unsigned char) (width >> 8),
+        (unsigned char) width,
+        (unsigned char) (height >> 24),
+        (unsigned char) (height >> 16),
+        (unsigned char) (height >> 8),
+        (unsigned char) height,
+        8,
+        2,
+        0,
+        0,
+        0};
+    if (sink->sputn((const char *) signature, 8) != 8 || !write_chunk(sink, "IHDR", header, sizeof(header)))
+    {
+        return false;
+    }
+
+    z_stream stream = {};
+    if (deflateInit(&stream, compression_level < 0 || compression_level > 9 ? Z_DEFAULT_COMPRESSION : compression_level)
+        != Z_OK)
+    {
+        return false;
+    }
+    bool ok = true;
+    std::vector<unsigned char> out(1 << 16);
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    // Writes the deflated data once the buffer is full, and at the end.
+    auto deflate_rows = [&](int flush) {
+        int result;
+        do
+        {
+            result = deflate(&stream, flush);
+            if (stream.avail_out == 0 || (result == Z_STREAM_END && stream.next_out != out.data()))
+            {
+                ok = ok && write_chunk(sink, "IDAT", out.data(), stream.next_out - out.data());
+                stream.next_out = out.data();
+                stream.avail_out = out.size();
+            }
+        } while (ok && (stream.avail_in > 0 || (flush == Z_FINISH && result == Z_OK)));
+    };
+
+    // Each row is stored as its difference to the row above, which is mostly 0 on the white of a page.
+    size_t row_size = width * 3;
+    std::vector<unsigned char> row(1 + row_size);
+    row[0] = 2;
+    for (size_t y = 0; y < height && ok; y++)
+    {
+        const uint8_t *line = pixels + y * row_size;
+        for (size_t i = 0; i < row_size; i++)
+        {
+            row[1 + i] = y > 0 ? uint8_t(line[i] - line[i - row_size]) : line[i];
+        }
+        stream.next_in = row.data();
+        stream.avail_in = row.size();
+        deflate_rows(Z_NO_FLUSH);
+    }
+    if (ok)
+    {
+        deflate_rows(Z_FINISH);
+    }
+    deflateEnd(&stream);
+
+    return ok && write_chunk(sink, "IEND", NULL, 0) && sink->pubsync() == 0;
+}
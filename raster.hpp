@@ -0,0 +1,130 @@
+/*
+ * raster.hpp
+ *
+ * Anti-aliased rasterizer of the strokes, for png thumbnails without a round trip through svg.
+ */
+
+#ifndef RASTER_HPP
+#define RASTER_HPP
+
+#include "simple_svg_1.0.0.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <vector>
+
+/** an RGB image of strokes on white, which is rasterized in tiles on several threads.
+ *
+ * The strokes are collected first, each with its bounding box in pixels. render() sorts them into the tiles of the
+ * image they overlap, and the threads take one tile at a time. Each tile is drawn on its own, in the order the strokes
+ * were added, so the image does not depend on the number of threads.
+ *
+ * Center lines are drawn as the union of round capped segments, outlines are filled with the nonzero rule from the
+ * signed area their edges cover in each pixel. Both are anti-aliased by the coverage of the pixels. Lines thinner than
+ * a pixel are drawn one pixel wide and correspondingly lighter.
+ */
+class Raster
+{
+public:
+    /**
+     * @param layout of the page, which is scaled to the image.
+     * @param size of the longer side of the image in pixels.
+     */
+    Raster(const svg::Layout &layout, unsigned int size);
+    Raster(const Raster &) = delete;
+    Raster &operator=(const Raster &) = delete;
+
+    size_t width() const
+    {
+        return width_;
+    }
+
+    size_t height() const
+    {
+        return height_;
+    }
+
+    /** adds a center line of width in user units.
+     *
+     */
+    void add_line(const std::vector<svg::Point> &points, double width, const svg::Color &color);
+
+    /** adds a closed outline, which is filled.
+     *
+     */
+    void add_outline(const std::vector<svg::Point> &points, const svg::Color &color);
+
+    /** draws all strokes into the image.
+     *
+     * @param threads amount of threads the tiles are shared by.
+     */
+    void render(unsigned int threads);
+
+    /** the rendered image, as rows of red, green and blue bytes.
+     *
+     */
+    const std::vector<uint8_t> &pixels() const
+    {
+        return pixels_;
+    }
+
+    /** writes the rendered image as png to sink, and flushes it.
+     *
+     * @param compression_level the zlib compression level from 0 to 9, or -1 for the default of zlib.
+     * @return false if writing failed.
+     */
+    bool write_png(std::streambuf *sink, int compression_level) const;
+
+private:
+    // edge of the square tiles in pixels.
+    static constexpr size_t tile_size = 64;
+
+    struct Shape
+    {
+        // range of the shape in points, which are in pixels.
+        size_t first;
+        size_t count;
+        // half the width of a line, or 0 for an outline.
+        float radius;
+        // opacity of thin lines.
+        float alpha;
+        float red;
+        float green;
+        float blue;
+        // bounding box in pixels, including the width of a line.
+        float min_x;
+        float min_y;
+        float max_x;
+        float max_y;
+    };
+
+    struct Scratch;
+
+    void add_shape(const std::vector<svg::Point> &points, float radius, float alpha, const svg::Color &color);
+    void render_tile(size_t column, size_t row, const std::vector<uint32_t> &shapes, Scratch &scratch);
+    void draw_line(const Shape &shape, size_t x0, size_t y0, Scratch &scratch) const;
+    void fill_outline(const Shape &shape, size_t x0, size_t y0, Scratch &scratch) const;
+
+    svg::Layout layout;
+    // pixels per user unit.
+    double scale;
+    size_t width_;
+    size_t height_;
+    size_t columns;
+    size_t rows;
+    // x/y pairs of all shapes. Floats keep the exactness of a pixel at half the memory of doubles.
+    std::vector<float> points;
+    std::vector<Shape> shapes;
+    std::vector<uint8_t> pixels_;
+};
+
+/** writes an RGB image as png to sink.
+ *
+ * The rows are deflated with zlib as they are filtered, into IDAT chunks of up to 64 KiB.
+ *
+ * @param pixels rows of red, green and blue bytes.
+ * @return false if writing failed.
+ */
+bool write_png(std::streambuf *sink, const uint8_t *pixels, size_t width, size_t height, int compression_level);
+
+#endif
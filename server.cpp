@@ -0,0 +1,485 @@
+/*
+ * server.cpp
+ *
+ * Conversion server on a unix domain socket, and its client.
+ */
+
+#include "server.hpp"
+#include "gzip_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+// requests larger than this are refused, so a broken client can not exhaust the memory of the server.
+const uint32_t max_payload = 1u << 30;
+// responses a connection may have pending, before its requests are no longer read.
+const size_t max_pending = 64;
+
+bool send_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool receive_all(int fd, char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool send_frame(int fd, char kind, const char *data, size_t size)
+{
+    if (size > max_payload)
+    {
+        return false;
+    }
+    char header[5] = {kind, char(size & 0xff), char((size >> 8) & 0xff), char((size >> 16) & 0xff), char(size >> 24)};
+    return send_all(fd, header, sizeof(header)) && send_all(fd, data, size);
+}
+
+/** receives the next frame.
+ *
+ * @return false at the end of the connection, on errors and for oversized frames.
+ */
+bool receive_frame(int fd, char &kind, std::string &payload)
+{
+    unsigned char header[5];
+    if (!receive_all(fd, (char *) header, sizeof(header)))
+    {
+        return false;
+    }
+    uint32_t size = header[1] | header[2] << 8 | header[3] << 16 | uint32_t(header[4]) << 24;
+    if (size > max_payload)
+    {
+        return false;
+    }
+    kind = header[0];
+    payload.resize(size);
+    return receive_all(fd, &payload[0], size);
+}
+
+bool socket_address(const std::string &socket_path, sockaddr_un &address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "socket path " << socket_path << " is too long" << std::endl;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return true;
+}
+
+/** connects to the socket at address.
+ *
+ * @return the socket, or -1 if nobody listens on it.
+ */
+int connect_to(const sockaddr_un &address)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, (const sockaddr *) &address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool write_output(const std::string &svg_file_name, const std::string &svg, int compression_level)
+{
+    if (svg_file_name == "-")
+    {
+        std::cout.write(svg.data(), svg.size());
+        std::cout.flush();
+        return std::cout.good();
+    }
+    if (is_svgz(svg_file_name))
+    {
+        GzipFileBuf gzip_file;
+        if (!gzip_file.open(svg_file_name, compression_level))
+        {
+            return false;
+        }
+        bool written = gzip_file.sputn(svg.data(), svg.size()) == std::streamsize(svg.size());
+        return gzip_file.close() && written;
+    }
+    std::ofstream svg_file(svg_file_name, std::ios::binary | std::ios::trunc);
+    svg_file.write(svg.data(), svg.size());
+    svg_file.close();
+    return !svg_file.fail();
+}
+}
+
+ConversionServer::ConversionServer(const ConvertOptions &options, unsigned int workers)
+    : options(options), listen_fd(-1), stopping(false), closing_pool(false)
+{
+    for (unsigned int i = 0; i < std::max(workers, 1u); i++)
+    {
+        this->workers.emplace_back(&ConversionServer::work, this);
+    }
+}
+
+ConversionServer::~ConversionServer()
+{
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        closing_pool = true;
+    }
+    tasks_changed.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    if (listen_fd >= 0)
+    {
+        close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+}
+
+bool ConversionServer::listen(const std::string &socket_path)
+{
+    sockaddr_un address;
+    if (!socket_address(socket_path, address))
+    {
+        return false;
+    }
+
+    // A socket file is only replaced, if no server answers on it.
+    struct stat path_stat;
+    if (lstat(socket_path.c_str(), &path_stat) == 0)
+    {
+        if (!S_ISSOCK(path_stat.st_mode))
+        {
+            std::cerr << socket_path << " exists and is not a socket" << std::endl;
+            return false;
+        }
+        int fd = connect_to(address);
+        if (fd >= 0)
+        {
+            close(fd);
+            std::cerr << "a server is already listening on " << socket_path << std::endl;
+            return false;
+        }
+        unlink(socket_path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (const sockaddr *) &address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+    {
+        std::cerr << "error listening on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    listen_fd = fd;
+    this->socket_path = socket_path;
+    return true;
+}
+
+void ConversionServer::run()
+{
+    while (!stopping)
+    {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+        {
+            if (stopping)
+            {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            // Running out of descriptors or memory under load passes once connections end, so the server keeps
+            // accepting after a pause instead of ending.
+            std::cerr << "error accepting a connection: " << std::strerror(errno) << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(connections_mutex);
+        if (stopping)
+        {
+            close(fd);
+            break;
+        }
+        connections.insert(fd);
+        std::thread(&ConversionServer::serve_connection, this, fd).detach();
+    }
+
+    // No more requests are read. The connections end once their responses are sent.
+    std::unique_lock<std::mutex> lock(connections_mutex);
+    for (int fd : connections)
+    {
+        shutdown(fd, SHUT_RD);
+    }
+    connections_changed.wait(lock, [this]() { return connections.empty(); });
+}
+
+void ConversionServer::stop()
+{
+    stopping = true;
+    if (listen_fd >= 0)
+    {
+        shutdown(listen_fd, SHUT_RDWR);
+    }
+}
+
+ConversionServer::Response ConversionServer::convert_request(char kind, const std::string &payload)
+{
+    std::stringbuf svg;
+    bool ok;
+    if (kind == 'p')
+    {
+        ok = convert_to_stream(payload, NULL, 0, &svg, options);
+    }
+    else if (kind == 'd')
+    {
+        ok = convert_to_stream("request", (const unsigned char *) payload.data(), payload.size(), &svg, options);
+    }
+    else
+    {
+        return Response{'e', "unknown request kind"};
+    }
+
+    if (!ok)
+    {
+        return Response{'e', "conversion failed"};
+    }
+    return Response{'o', svg.str()};
+}
+
+void ConversionServer::serve_connection(int fd)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::future<Response>> pending;
+    bool reading = true;
+    bool broken = false;
+
+    // Sends the responses in the order of the requests, each as soon as it and all before it are converted.
+    std::thread writer([&]() {
+        while (true)
+        {
+            std::future<Response> next;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&]() { return !pending.empty() || !reading; });
+                if (pending.empty())
+                {
+                    break;
+                }
+                next = std::move(pending.front());
+                pending.pop_front();
+            }
+            changed.notify_all();
+
+            Response response;
+            try
+            {
+                response = next.get();
+            }
+            catch (const std::exception &e)
+            {
+                response = Response{'e', e.what()};
+            }
+            if (!send_frame(fd, response.kind, response.payload.data(), response.payload.size()))
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                broken = true;
+                changed.notify_all();
+                break;
+            }
+        }
+    });
+
+    char kind;
+    std::string payload;
+    while (receive_frame(fd, kind, payload))
+    {
+        auto task = std::make_shared<std::packaged_task<Response()>>(
+            [this, kind, payload = std::move(payload)]() { return convert_request(kind, payload); });
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return pending.size() < max_pending || broken; });
+            if (broken)
+            {
+                break;
+            }
+            pending.push_back(task->get_future());
+        }
+        changed.notify_all();
+        {
+            std::lock_guard<std::mutex> lock(tasks_mutex);
+            tasks.push([task]() { (*task)(); });
+        }
+        tasks_changed.notify_one();
+        payload.clear();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        reading = false;
+    }
+    changed.notify_all();
+    writer.join();
+
+    std::lock_guard<std::mutex> lock(connections_mutex);
+    close(fd);
+    connections.erase(fd);
+    connections_changed.notify_all();
+}
+
+void ConversionServer::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(tasks_mutex);
+            tasks_changed.wait(lock, [this]() { return !tasks.empty() || closing_pool; });
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
+
+size_t convert_remote(const std::string &socket_path,
+    const std::vector<std::pair<std::string, std::string>> &jobs,
+    int compression_level,
+    bool report)
+{
+    sockaddr_un address;
+    int fd = socket_address(socket_path, address) ? connect_to(address) : -1;
+    if (fd < 0)
+    {
+        std::cerr << "error connecting to " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return jobs.size();
+    }
+
+    std::thread sender([&]() {
+        std::vector<unsigned char> data;
+        for (auto &job : jobs)
+        {
+            const std::string &will_file_name = job.first;
+            bool sent;
+            if (will_file_name == "-")
+            {
+                read_stdin(data);
+                sent = send_frame(fd, 'd', (const char *) data.data(), data.size());
+            }
+            else
+            {
+                // The server may run in another working directory.
+                char *path = realpath(will_file_name.c_str(), NULL);
+                std::string absolute = path != NULL ? path : will_file_name;
+                std::free(path);
+                sent = send_frame(fd, 'p', absolute.data(), absolute.size());
+            }
+            if (!sent)
+            {
+                break;
+            }
+        }
+        shutdown(fd, SHUT_WR);
+    });
+
+    size_t failed = 0;
+    char kind;
+    std::string payload;
+    for (auto &job : jobs)
+    {
+        bool ok = false;
+        if (!receive_frame(fd, kind, payload))
+        {
+            std::cerr << "error converting " << job.first << ": connection to " << socket_path << " lost" << std::endl;
+        }
+        else if (kind != 'o')
+        {
+            std::cerr << "error converting " << job.first << ": " << payload << std::endl;
+        }
+        else if (!write_output(job.second, payload, compression_level))
+        {
+            std::cerr << "error writing " << job.second << std::endl;
+        }
+        else
+        {
+            ok = true;
+        }
+
+        if (!ok)
+        {
+            failed++;
+        }
+        if (report)
+        {
+            if (ok)
+            {
+                std::cout << "ok " << job.first << " -> " << job.second << std::endl;
+            }
+            else
+            {
+                std::cout << "failed " << job.first << std::endl;
+            }
+        }
+    }
+
+    sender.join();
+    close(fd);
+    return failed;
+}
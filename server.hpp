@@ -0,0 +1,104 @@
+/*
+ * server.hpp
+ *
+ * Conversion server on a unix domain socket, and its client.
+ */
+
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include "convert.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** converts .will files for clients on a unix domain socket.
+ *
+ * Requests and responses are frames of a kind byte, the length of the payload as 4 byte little endian and the
+ * payload. A request of kind 'p' carries the path of a .will file, which the server reads itself. A request of kind
+ * 'd' carries the .will file. The response is of kind 'o' with the svg, or of kind 'e' with an error message.
+ *
+ * A client may send any amount of requests without waiting for the responses. The requests of all connections are
+ * converted on one pool of worker threads, and the responses of a connection are sent in the order of its requests.
+ * Each conversion uses the options the server was started with.
+ */
+class ConversionServer
+{
+public:
+    ConversionServer(const ConvertOptions &options, unsigned int workers);
+    ConversionServer(const ConversionServer &) = delete;
+    ConversionServer &operator=(const ConversionServer &) = delete;
+    ~ConversionServer();
+
+    /** creates the socket. The socket file of a server, that is gone, is replaced.
+     *
+     * @return false if the socket could not be created, or another server is listening on it.
+     */
+    bool listen(const std::string &socket_path);
+
+    /** accepts connections until stop() is called. Returns after all connections are closed.
+     *
+     * Errors of accept(), like running out of file descriptors, are reported, and accepting is tried again after a
+     * short pause.
+     */
+    void run();
+
+    /** lets run() return, and closes all connections once their pending responses are sent.
+     *
+     * Only sets a flag and shuts the sockets down, so it can be called from a signal handler.
+     */
+    void stop();
+
+private:
+    struct Response
+    {
+        char kind;
+        std::string payload;
+    };
+
+    Response convert_request(char kind, const std::string &payload);
+    void serve_connection(int fd);
+    void work();
+
+    ConvertOptions options;
+    std::string socket_path;
+    int listen_fd;
+    std::atomic<bool> stopping;
+
+    // the worker pool.
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_changed;
+    bool closing_pool;
+
+    // the open connections, which are served on their own threads.
+    std::set<int> connections;
+    std::mutex connections_mutex;
+    std::condition_variable connections_changed;
+};
+
+/** converts files on the server listening on socket_path.
+ *
+ * All requests are sent before the first response is awaited, so the server converts them in parallel. Inputs named
+ * - are read from stdin and sent as data, others are sent as absolute path. Outputs named - are written to stdout,
+ * outputs ending with .svgz are compressed.
+ *
+ * @param jobs pairs of input and output file names.
+ * @param compression_level of the .svgz outputs from 0 to 9, or -1 for the default of zlib.
+ * @param report print the result of each file on std::cout, like the batch mode.
+ * @return amount of files, that failed to convert.
+ */
+size_t convert_remote(const std::string &socket_path,
+    const std::vector<std::pair<std::string, std::string>> &jobs,
+    int compression_level,
+    bool report);
+
+#endif
@@ -34,9 +34,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef SIMPLE_SVG_HPP
 #define SIMPLE_SVG_HPP
 
+#include <charconv>
+#include <cmath>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <iostream>
@@ -51,19 +56,84 @@ std::string attribute(std::string const &attribute_name, T const &value, std::st
     ss << attribute_name << "=\"" << value << unit << "\" ";
     return ss.str();
 }
-std::string elemStart(std::string const &element_name)
+inline std::string elemStart(std::string const &element_name)
 {
     return "\t<" + element_name + " ";
 }
-std::string elemEnd(std::string const &element_name)
+inline std::string elemEnd(std::string const &element_name)
 {
     return "</" + element_name + ">\n";
 }
-std::string emptyElemEnd()
+inline std::string emptyElemEnd()
 {
     return "/>\n";
 }
 
+// Appends value to out. With a precision >= 0 at most precision decimals are written, without trailing zeros.
+//  Otherwise the shortest representation that reads back as value is used. Does not depend on the locale.
+inline void appendNumber(std::string &out, double value, int precision = -1)
+{
+    char buffer[64];
+    std::to_chars_result result;
+    if (precision >= 0)
+    {
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, precision);
+        if (result.ec == std::errc() && precision > 0)
+        {
+            while (result.ptr[-1] == '0')
+                --result.ptr;
+            if (result.ptr[-1] == '.')
+                --result.ptr;
+        }
+    }
+    if (precision < 0 || result.ec != std::errc())
+        result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+
+    // Values that round to zero would be written as "-0".
+    if (result.ptr - buffer == 2 && buffer[0] == '-' && buffer[1] == '0')
+        out += '0';
+    else
+        out.append(buffer, result.ptr);
+}
+
+inline void appendNumber(std::string &out, int value)
+{
+    char buffer[16];
+    std::to_chars_result result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+// Appends value / 10^precision to out, without trailing zeros and without the zero before the decimal point.
+//  precision has to be between 0 and 9.
+inline void appendFixed(std::string &out, long long value, int precision)
+{
+    static const long long powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+    unsigned long long magnitude = value;
+    if (value < 0)
+    {
+        out += '-';
+        magnitude = 0 - magnitude;
+    }
+    unsigned long long integer = magnitude / powers[precision];
+    unsigned long long fraction = magnitude % powers[precision];
+
+    char buffer[32];
+    if (integer != 0 || fraction == 0)
+        out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), integer).ptr);
+    if (fraction == 0)
+        return;
+
+    while (fraction % 10 == 0)
+    {
+        fraction /= 10;
+        --precision;
+    }
+    char *end = std::to_chars(buffer, buffer + sizeof(buffer), fraction).ptr;
+    out += '.';
+    out.append(precision - (end - buffer), '0');
+    out.append(buffer, end);
+}
+
 // Quick optional return type.  This allows functions to return an invalid
 //  value if no good return is possible.  The user checks for validity
 //  before using the returned value.
@@ -142,7 +212,7 @@ struct Point
     double x;
     double y;
 };
-optional<Point> getMinPoint(std::vector<Point> const &points)
+inline optional<Point> getMinPoint(std::vector<Point> const &points)
 {
     if (points.empty())
         return optional<Point>();
@@ -157,7 +227,7 @@ optional<Point> getMinPoint(std::vector<Point> const &points)
     }
     return optional<Point>(min);
 }
-optional<Point> getMaxPoint(std::vector<Point> const &points)
+inline optional<Point> getMaxPoint(std::vector<Point> const &points)
 {
     if (points.empty())
         return optional<Point>();
@@ -210,7 +280,7 @@ struct Layout
 };
 
 // Convert coordinates in user space to SVG native space.
-double translateX(double x, Layout const &layout)
+inline double translateX(double x, Layout const &layout)
 {
     if (layout.origin == Layout::BottomRight || layout.origin == Layout::TopRight)
         return layout.dimensions.width - ((x + layout.origin_offset.x) * layout.scale);
@@ -218,18 +288,73 @@ double translateX(double x, Layout const &layout)
         return (layout.origin_offset.x + x) * layout.scale;
 }
 
-double translateY(double y, Layout const &layout)
+inline double translateY(double y, Layout const &layout)
 {
     if (layout.origin == Layout::BottomLeft || layout.origin == Layout::BottomRight)
         return layout.dimensions.height - ((y + layout.origin_offset.y) * layout.scale);
     else
         return (layout.origin_offset.y + y) * layout.scale;
 }
-double translateScale(double dimension, Layout const &layout)
+inline double translateScale(double dimension, Layout const &layout)
 {
     return dimension * layout.scale;
 }
 
+// The transform of a layout, taken apart once per shape instead of for each coordinate. A coordinate becomes
+//  (value + offset) * scale, subtracted from the page size on flipped axes, which rounds exactly like translateX/Y.
+struct Transform
+{
+    explicit Transform(Layout const &layout)
+        : offset(layout.origin_offset), scale(layout.scale), size(layout.dimensions.width, layout.dimensions.height)
+    {
+    }
+    Point offset;
+    double scale;
+    Point size;
+};
+
+// Transforms count points to interleaved x/y values in SVG native space. Specialized per origin, so the loop has
+//  no branches and can be vectorized.
+template <bool flip_x, bool flip_y>
+inline void transformPoints(Point const *points, size_t count, Transform const &transform, double *out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        double x = (points[i].x + transform.offset.x) * transform.scale;
+        double y = (points[i].y + transform.offset.y) * transform.scale;
+        out[2 * i] = flip_x ? transform.size.x - x : x;
+        out[2 * i + 1] = flip_y ? transform.size.y - y : y;
+    }
+}
+
+inline void transformPoints(std::vector<Point> const &points, Layout const &layout, std::vector<double> &out)
+{
+    Transform transform(layout);
+    out.resize(2 * points.size());
+    switch (layout.origin)
+    {
+    case Layout::TopLeft:
+        transformPoints<false, false>(points.data(), points.size(), transform, out.data());
+        break;
+    case Layout::BottomLeft:
+        transformPoints<false, true>(points.data(), points.size(), transform, out.data());
+        break;
+    case Layout::TopRight:
+        transformPoints<true, false>(points.data(), points.size(), transform, out.data());
+        break;
+    case Layout::BottomRight:
+        transformPoints<true, true>(points.data(), points.size(), transform, out.data());
+        break;
+    }
+}
+
+// Scratch space for the transformed points of one shape at a time, which keeps its capacity on each thread.
+inline std::vector<double> &transformScratch()
+{
+    static thread_local std::vector<double> scratch;
+    return scratch;
+}
+
 class Serializeable
 {
 public:
@@ -238,6 +363,11 @@ public:
     }
     virtual ~Serializeable(){};
     virtual std::string toString(Layout const &layout) const = 0;
+    // Appends the serialized object to out. Classes with a faster path than toString() override this.
+    virtual void appendTo(std::string &out, Layout const &layout) const
+    {
+        out += toString(layout);
+    }
 };
 
 class Color : public Serializeable
@@ -326,14 +456,39 @@ public:
     virtual ~Color()
     {
     }
-    std::string toString(Layout const &) const
+    std::string toString(Layout const &layout) const
+    {
+        std::string out;
+        appendTo(out, layout);
+        return out;
+    }
+    void appendTo(std::string &out, Layout const &) const
     {
-        std::stringstream ss;
         if (transparent)
-            ss << "transparent";
-        else
-            ss << "rgb(" << red << "," << green << "," << blue << ")";
-        return ss.str();
+        {
+            out += "transparent";
+            return;
+        }
+        out += "rgb(";
+        appendNumber(out, red);
+        out += ',';
+        appendNumber(out, green);
+        out += ',';
+        appendNumber(out, blue);
+        out += ')';
+    }
+    // The channels from 0 to 255, for renderers that do not go through the svg.
+    int getRed() const
+    {
+        return red;
+    }
+    int getGreen() const
+    {
+        return green;
+    }
+    int getBlue() const
+    {
+        return blue;
     }
 
     Color &operator=(Color other)
@@ -371,9 +526,15 @@ public:
     }
     std::string toString(Layout const &layout) const
     {
-        std::stringstream ss;
-        ss << attribute("fill", color.toString(layout));
-        return ss.str();
+        std::string out;
+        appendTo(out, layout);
+        return out;
+    }
+    void appendTo(std::string &out, Layout const &layout) const
+    {
+        out += "fill=\"";
+        color.appendTo(out, layout);
+        out += "\" ";
     }
 
     Fill &operator=(Fill other)
@@ -396,14 +557,22 @@ public:
     {
     }
     std::string toString(Layout const &layout) const
+    {
+        std::string out;
+        appendTo(out, layout);
+        return out;
+    }
+    void appendTo(std::string &out, Layout const &layout) const
     {
         // If stroke width is invalid.
         if (width < 0)
-            return std::string();
+            return;
 
-        std::stringstream ss;
-        ss << attribute("stroke-width", translateScale(width, layout)) << attribute("stroke", color.toString(layout));
-        return ss.str();
+        out += "stroke-width=\"";
+        appendNumber(out, translateScale(width, layout));
+        out += "\" stroke=\"";
+        color.appendTo(out, layout);
+        out += "\" ";
     }
 
     Stroke &operator=(Stroke other)
@@ -424,6 +593,8 @@ public:
     Font() : size(12), family("Verdana")
     {
     }
+    Font(Font const &) = default;
+    Font(Font &&) = default;
     Font(double size, std::string const &family) : size(size), family(family)
     {
     }
@@ -437,7 +608,7 @@ public:
     Font &operator=(Font other)
     {
         size = other.size;
-        family = other.family;
+        family = std::move(other.family);
         return *this;
     }
 
@@ -453,17 +624,72 @@ public:
     Shape(Fill const &fill, Stroke const &stroke) : fill(fill), stroke(stroke)
     {
     }
+    // The virtual destructor would suppress the moves, which the shapes with points rely on.
+    Shape(Shape const &) = default;
+    Shape(Shape &&) = default;
+    Shape &operator=(Shape const &) = default;
+    Shape &operator=(Shape &&) = default;
     virtual ~Shape()
     {
     }
     virtual std::string toString(Layout const &layout) const = 0;
     virtual void offset(Point const &offset) = 0;
+    void setFill(Fill const &fill)
+    {
+        this->fill = fill;
+    }
+    void setStroke(Stroke const &stroke)
+    {
+        this->stroke = stroke;
+    }
+    // Refers to a class of a StyleSheet, which then replaces the fill and stroke attributes. Empty to write them.
+    void setClass(std::string const &name)
+    {
+        style_class = name;
+    }
+    // Appends the fill and stroke attributes, even if the shape has a class.
+    void appendStyle(std::string &out, Layout const &layout) const
+    {
+        fill.appendTo(out, layout);
+        stroke.appendTo(out, layout);
+    }
 
 protected:
     Fill fill;
     Stroke stroke;
+    std::string style_class;
+
+    void appendClassOrStyle(std::string &out, Layout const &layout) const
+    {
+        if (style_class.empty())
+        {
+            appendStyle(out, layout);
+            return;
+        }
+        out += "class=\"";
+        out += style_class;
+        out += "\" ";
+    }
+    std::string styleToString(Layout const &layout) const
+    {
+        std::string out;
+        appendClassOrStyle(out, layout);
+        return out;
+    }
 };
-template <typename T> std::string vectorToString(std::vector<T> collection, Layout const &layout)
+inline void appendPoints(std::string &out, std::vector<Point> const &points, Layout const &layout, int precision = -1)
+{
+    std::vector<double> &native = transformScratch();
+    transformPoints(points, layout, native);
+    for (size_t i = 0; i < native.size(); i += 2)
+    {
+        appendNumber(out, native[i], precision);
+        out += ',';
+        appendNumber(out, native[i + 1], precision);
+        out += ' ';
+    }
+}
+template <typename T> std::string vectorToString(std::vector<T> const &collection, Layout const &layout)
 {
     std::string combination_str;
     for (unsigned i = 0; i < collection.size(); ++i)
@@ -487,7 +713,7 @@ public:
         std::stringstream ss;
         ss << elemStart("circle") << attribute("cx", translateX(center.x, layout))
            << attribute("cy", translateY(center.y, layout)) << attribute("r", translateScale(radius, layout))
-           << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
+           << styleToString(layout) << emptyElemEnd();
         return ss.str();
     }
     void offset(Point const &offset)
@@ -502,6 +728,7 @@ public:
         radius = other.radius;
         fill = other.fill;
         stroke = other.stroke;
+        style_class = std::move(other.style_class);
         return *this;
     }
 
@@ -525,7 +752,7 @@ public:
         std::stringstream ss;
         ss << elemStart("ellipse") << attribute("cx", translateX(center.x, layout))
            << attribute("cy", translateY(center.y, layout)) << attribute("rx", translateScale(radius_width, layout))
-           << attribute("ry", translateScale(radius_height, layout)) << fill.toString(layout) << stroke.toString(layout)
+           << attribute("ry", translateScale(radius_height, layout)) << styleToString(layout)
            << emptyElemEnd();
         return ss.str();
     }
@@ -542,6 +769,7 @@ public:
         radius_height = other.radius_height;
         fill = other.fill;
         stroke = other.stroke;
+        style_class = std::move(other.style_class);
         return *this;
     }
 
@@ -566,7 +794,7 @@ public:
         std::stringstream ss;
         ss << elemStart("rect") << attribute("x", translateX(edge.x, layout))
            << attribute("y", translateY(edge.y, layout)) << attribute("width", translateScale(width, layout))
-           << attribute("height", translateScale(height, layout)) << fill.toString(layout) << stroke.toString(layout)
+           << attribute("height", translateScale(height, layout)) << styleToString(layout)
            << emptyElemEnd();
         return ss.str();
     }
@@ -583,6 +811,7 @@ public:
         height = other.height;
         fill = other.fill;
         stroke = other.stroke;
+        style_class = std::move(other.style_class);
         return *this;
     }
 
@@ -623,6 +852,7 @@ public:
         end_point = other.end_point;
         fill = other.fill;
         stroke = other.stroke;
+        style_class = std::move(other.style_class);
         return *this;
     }
 
@@ -635,6 +865,8 @@ class Polygon : public Shape
 {
 public:
     Polygon() = default;
+    Polygon(Polygon const &) = default;
+    Polygon(Polygon &&) = default;
     Polygon(Fill const &fill, Stroke const &stroke) : Shape(fill, stroke)
     {
     }
@@ -646,18 +878,27 @@ public:
         points.push_back(point);
         return *this;
     }
+    // Amount of decimals written for each coordinate. Negative values use the shortest exact representation.
+    void setPrecision(int decimals)
+    {
+        precision = decimals;
+    }
     std::string toString(Layout const &layout) const
     {
-        std::stringstream ss;
-        ss << elemStart("polygon");
+        std::string out;
+        appendTo(out, layout);
+        return out;
+    }
+    void appendTo(std::string &out, Layout const &layout) const
+    {
+        out += elemStart("polygon");
 
-        ss << "points=\"";
-        for (unsigned i = 0; i < points.size(); ++i)
-            ss << translateX(points[i].x, layout) << "," << translateY(points[i].y, layout) << " ";
-        ss << "\" ";
+        out += "points=\"";
+        appendPoints(out, points, layout, precision);
+        out += "\" ";
 
-        ss << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
-        return ss.str();
+        appendClassOrStyle(out, layout);
+        out += emptyElemEnd();
     }
     void offset(Point const &offset)
     {
@@ -667,31 +908,36 @@ public:
             points[i].y += offset.y;
         }
     }
+    std::vector<Point> points;
 
     Polygon &operator=(Polygon other)
     {
-        points = other.points;
+        points = std::move(other.points);
         fill = other.fill;
         stroke = other.stroke;
+        style_class = std::move(other.style_class);
+        precision = other.precision;
         return *this;
     }
 
 private:
-    std::vector<Point> points;
+    int precision = -1;
 };
 
 class Polyline : public Shape
 {
 public:
     Polyline() = default;
+    Polyline(Polyline const &) = default;
+    Polyline(Polyline &&) = default;
     Polyline(Fill const &fill, Stroke const &stroke) : Shape(fill, stroke)
     {
     }
     Polyline(Stroke const &stroke) : Shape(Color::Transparent, stroke)
     {
     }
-    Polyline(std::vector<Point> const &points, Fill const &fill = Fill(), Stroke const &stroke = Stroke())
-        : Shape(fill, stroke), points(points)
+    Polyline(std::vector<Point> points, Fill const &fill = Fill(), Stroke const &stroke = Stroke())
+        : Shape(fill, stroke), points(std::move(points))
     {
     }
     Polyline &operator<<(Point const &point)
@@ -699,18 +945,31 @@ public:
         points.push_back(point);
         return *this;
     }
+    // Amount of decimals written for each coordinate. Negative values use the shortest exact representation.
+    void setPrecision(int decimals)
+    {
+        precision = decimals;
+    }
+    int getPrecision() const
+    {
+        return precision;
+    }
     std::string toString(Layout const &layout) const
     {
-        std::stringstream ss;
-        ss << elemStart("polyline");
+        std::string out;
+        appendTo(out, layout);
+        return out;
+    }
+    void appendTo(std::string &out, Layout const &layout) const
+    {
+        out += elemStart("polyline");
 
-        ss << "points=\"";
-        for (unsigned i = 0; i < points.size(); ++i)
-            ss << translateX(points[i].x, layout) << "," << translateY(points[i].y, layout) << " ";
-        ss << "\" ";
+        out += "points=\"";
+        appendPoints(out, points, layout, precision);
+        out += "\" ";
 
-        ss << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
-        return ss.str();
+        appendClassOrStyle(out, layout);
+        out += emptyElemEnd();
     }
     void offset(Point const &offset)
     {
@@ -724,17 +983,142 @@ public:
 
     Polyline &operator=(Polyline other)
     {
-        points = other.points;
+        points = std::move(other.points);
+        fill = other.fill;
+        stroke = other.stroke;
+        style_class = std::move(other.style_class);
+        precision = other.precision;
+        return *this;
+    }
+
+private:
+    int precision = -1;
+};
+// Containers of polylines grow by moving them, only if the move can not throw.
+static_assert(std::is_nothrow_move_constructible<Polyline>::value, "Polyline has to be moved, not copied");
+
+// A polyline written as <path> with relative line commands, which is much shorter than the absolute points of
+//  Polyline. The coordinates are rounded to precision decimals before the differences are taken, so the rounding
+//  errors do not add up along the path.
+class Path : public Shape
+{
+public:
+    Path() = default;
+    Path(Path const &) = default;
+    Path(Path &&) = default;
+    Path(Fill const &fill, Stroke const &stroke) : Shape(fill, stroke)
+    {
+    }
+    Path(Stroke const &stroke) : Shape(Color::Transparent, stroke)
+    {
+    }
+    Path &operator<<(Point const &point)
+    {
+        points.push_back(point);
+        return *this;
+    }
+    // Amount of decimals written for each coordinate, between 0 and 9.
+    void setPrecision(int decimals)
+    {
+        precision = decimals < 0 ? 0 : (decimals > 9 ? 9 : decimals);
+    }
+    // Closes the path back to its first point, for outlines.
+    void setClosed(bool closed)
+    {
+        this->closed = closed;
+    }
+    std::string toString(Layout const &layout) const
+    {
+        std::string out;
+        appendTo(out, layout);
+        return out;
+    }
+    void appendTo(std::string &out, Layout const &layout) const
+    {
+        out += elemStart("path");
+
+        out += "d=\"";
+        if (!points.empty())
+        {
+            double scale = 1;
+            for (int i = 0; i < precision; ++i)
+                scale *= 10;
+
+            std::vector<double> &native = transformScratch();
+            transformPoints(points, layout, native);
+
+            long long x = std::llround(native[0] * scale);
+            long long y = std::llround(native[1] * scale);
+            bool dot = false;
+            out += 'M';
+            appendCoordinate(out, x, dot, true);
+            appendCoordinate(out, y, dot, false);
+            if (points.size() > 1)
+                out += 'l';
+            for (unsigned i = 1; i < points.size(); ++i)
+            {
+                long long next_x = std::llround(native[2 * i] * scale);
+                long long next_y = std::llround(native[2 * i + 1] * scale);
+                appendCoordinate(out, next_x - x, dot, i == 1);
+                appendCoordinate(out, next_y - y, dot, false);
+                x = next_x;
+                y = next_y;
+            }
+            if (closed)
+                out += 'z';
+        }
+        out += "\" ";
+
+        appendClassOrStyle(out, layout);
+        out += emptyElemEnd();
+    }
+    void offset(Point const &offset)
+    {
+        for (unsigned i = 0; i < points.size(); ++i)
+        {
+            points[i].x += offset.x;
+            points[i].y += offset.y;
+        }
+    }
+    std::vector<Point> points;
+
+    Path &operator=(Path other)
+    {
+        points = std::move(other.points);
         fill = other.fill;
         stroke = other.stroke;
+        style_class = std::move(other.style_class);
+        precision = other.precision;
+        closed = other.closed;
         return *this;
     }
+
+private:
+    int precision = 2;
+    bool closed = false;
+
+    // Writes a number with the least separators: none after a command, before a minus sign, or before a leading
+    //  decimal point if the previous number already had one.
+    void appendCoordinate(std::string &out, long long value, bool &dot, bool after_command) const
+    {
+        long long magnitude = value < 0 ? -value : value;
+        long long one = 1;
+        for (int i = 0; i < precision; ++i)
+            one *= 10;
+        bool leading_dot = magnitude != 0 && magnitude < one;
+        if (!after_command && value >= 0 && !(leading_dot && dot))
+            out += ' ';
+        appendFixed(out, value, precision);
+        dot = magnitude % one != 0;
+    }
 };
 
 class Text : public Shape
 {
 public:
     Text() = default;
+    Text(Text const &) = default;
+    Text(Text &&) = default;
     Text(Point const &origin, std::string const &content, Fill const &fill, Font const &font, Stroke const &stroke)
         : Shape(fill, stroke), origin(origin), content(content), font(font)
     {
@@ -743,7 +1127,7 @@ public:
     {
         std::stringstream ss;
         ss << elemStart("text") << attribute("x", translateX(origin.x, layout))
-           << attribute("y", translateY(origin.y, layout)) << fill.toString(layout) << stroke.toString(layout)
+           << attribute("y", translateY(origin.y, layout)) << styleToString(layout)
            << font.toString(layout) << ">" << content << elemEnd("text");
         return ss.str();
     }
@@ -756,7 +1140,7 @@ public:
     Text &operator=(Text other)
     {
         origin = other.origin;
-        content = other.content;
+        content = std::move(other.content);
         font = other.font;
         return *this;
     }
@@ -774,6 +1158,8 @@ public:
     LineChart() : scale(1)
     {
     }
+    LineChart(LineChart const &) = default;
+    LineChart(LineChart &&) = default;
     LineChart(Dimensions margin, double scale, Stroke const &axis_stroke)
         : axis_stroke(axis_stroke), margin(margin), scale(scale)
     {
@@ -808,7 +1194,7 @@ public:
         axis_stroke = other.axis_stroke;
         margin = other.margin;
         scale = other.scale;
-        polylines = other.polylines;
+        polylines = std::move(other.polylines);
         return *this;
     }
 
@@ -870,29 +1256,115 @@ private:
     }
 };
 
+inline std::string documentHeader(Layout const &layout)
+{
+    std::stringstream ss;
+    ss << "<?xml " << attribute("version", "1.0") << attribute("standalone", "no")
+       << "?>\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" "
+       << "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n<svg "
+       << attribute("width", layout.dimensions.width, "px") << attribute("height", layout.dimensions.height, "px")
+       << attribute("xmlns", "http://www.w3.org/2000/svg") << attribute("version", "1.1") << ">\n";
+    return ss.str();
+}
+// Header of a document that shows only the region of the page at view_origin, in SVG native space. The document is
+//  as large as the region, and the shapes keep the coordinates of the page.
+inline std::string documentHeader(Point const &view_origin, Dimensions const &view_dimensions)
+{
+    std::stringstream ss;
+    ss << "<?xml " << attribute("version", "1.0") << attribute("standalone", "no")
+       << "?>\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" "
+       << "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n<svg "
+       << attribute("width", view_dimensions.width, "px") << attribute("height", view_dimensions.height, "px")
+       << "viewBox=\"" << view_origin.x << " " << view_origin.y << " " << view_dimensions.width << " "
+       << view_dimensions.height << "\" " << attribute("xmlns", "http://www.w3.org/2000/svg")
+       << attribute("version", "1.1") << ">\n";
+    return ss.str();
+}
+inline std::string documentFooter()
+{
+    return elemEnd("svg");
+}
+
+// Shared styles of shapes. Each distinct combination of fill and stroke gets a short class name, and is written once
+//  into a <style> element instead of into every shape.
+class StyleSheet
+{
+public:
+    // Name of the class with the fill and stroke of shape. The class is added if it is new.
+    std::string const &intern(Shape const &shape, Layout const &layout)
+    {
+        attributes.clear();
+        shape.appendStyle(attributes, layout);
+        auto found = classes.find(attributes);
+        if (found != classes.end())
+            return found->second;
+
+        std::string name = "s" + std::to_string(classes.size());
+        appendRule(name, attributes);
+        return classes.emplace(attributes, name).first->second;
+    }
+    bool empty() const
+    {
+        return classes.empty();
+    }
+    void appendTo(std::string &out) const
+    {
+        out += "\t<style type=\"text/css\">";
+        out += rules;
+        out += "</style>\n";
+    }
+
+private:
+    std::unordered_map<std::string, std::string> classes;
+    std::string rules;
+    std::string attributes;
+
+    // Turns the attributes name="value" into the declarations name:value of a rule.
+    void appendRule(std::string const &name, std::string const &attributes)
+    {
+        rules += '.';
+        rules += name;
+        rules += '{';
+        bool value = false;
+        for (char c : attributes)
+        {
+            if (c == '"')
+            {
+                if (value)
+                    rules += ';';
+                value = !value;
+            }
+            else if (value)
+                rules += c;
+            else if (c == '=')
+                rules += ':';
+            else if (c != ' ')
+                rules += c;
+        }
+        if (rules.back() == ';')
+            rules.pop_back();
+        rules += '}';
+    }
+};
+
 class Document
 {
 public:
     Document() = default;
+    Document(Document const &) = default;
+    Document(Document &&) = default;
     Document(std::string const &file_name, Layout layout) : file_name(file_name), layout(layout)
     {
     }
 
     Document &operator<<(Shape const &shape)
     {
-        body_nodes_str += shape.toString(layout);
+        shape.appendTo(body_nodes_str, layout);
         return *this;
     }
     std::string toString() const
     {
-        std::stringstream ss;
-        ss << "<?xml " << attribute("version", "1.0") << attribute("standalone", "no")
-           << "?>\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" "
-           << "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n<svg "
-           << attribute("width", layout.dimensions.width, "px") << attribute("height", layout.dimensions.height, "px")
-           << attribute("xmlns", "http://www.w3.org/2000/svg") << attribute("version", "1.1") << ">\n"
-           << body_nodes_str << elemEnd("svg");
-        return ss.str();
+        return documentHeader(layout) + body_nodes_str + documentFooter();
     }
     bool save() const
     {
@@ -900,16 +1372,16 @@ public:
         if (!ofs.good())
             return false;
 
-        ofs << toString();
+        ofs << documentHeader(layout) << body_nodes_str << documentFooter();
         ofs.close();
         return true;
     }
 
     Document &operator=(Document other)
     {
-        file_name = other.file_name;
+        file_name = std::move(other.file_name);
         layout = other.layout;
-        body_nodes_str = other.body_nodes_str;
+        body_nodes_str = std::move(other.body_nodes_str);
         return *this;
     }
 
@@ -919,6 +1391,98 @@ private:
 
     std::string body_nodes_str;
 };
+
+// Writes the document while it is built. The header is written on construction, every shape as soon as it is
+//  added, and the footer on close(). Only the write buffer is kept in memory, regardless of the amount of shapes.
+class StreamingDocument
+{
+public:
+    StreamingDocument(std::string const &file_name, Layout layout, std::size_t buffer_size = 1 << 16)
+        : layout(layout), buffer(buffer_size), out(NULL)
+    {
+        ofs.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        ofs.open(file_name.c_str());
+        if (ofs.is_open())
+        {
+            out.rdbuf(ofs.rdbuf());
+            open = true;
+            out << documentHeader(layout);
+        }
+    }
+    // Writes to a stream buffer owned by the caller, like a compressing one or the one of std::cout. close() flushes
+    //  it but does not close it.
+    StreamingDocument(std::streambuf *sink, Layout layout) : layout(layout), out(sink)
+    {
+        open = sink != NULL;
+        if (open)
+            out << documentHeader(layout);
+    }
+    // Writes only the region of the page at view_origin, see documentHeader().
+    StreamingDocument(std::streambuf *sink, Layout layout, Point const &view_origin, Dimensions const &view_dimensions)
+        : layout(layout), out(sink)
+    {
+        open = sink != NULL;
+        if (open)
+            out << documentHeader(view_origin, view_dimensions);
+    }
+    StreamingDocument(StreamingDocument const &) = delete;
+    StreamingDocument &operator=(StreamingDocument const &) = delete;
+    ~StreamingDocument()
+    {
+        close();
+    }
+
+    // False if the file could not be opened or a write failed.
+    bool good() const
+    {
+        return open && out.good();
+    }
+    StreamingDocument &operator<<(Shape const &shape)
+    {
+        node_buffer.clear();
+        shape.appendTo(node_buffer, layout);
+        out.write(node_buffer.data(), node_buffer.size());
+        return *this;
+    }
+    // Name of the class with the fill and stroke of shape, see StyleSheet. The <style> element with all classes is
+    //  written on close(), as the last element of the document.
+    std::string const &classFor(Shape const &shape)
+    {
+        return styles.intern(shape, layout);
+    }
+    bool close()
+    {
+        if (!open)
+            return false;
+        open = false;
+
+        if (!styles.empty())
+        {
+            node_buffer.clear();
+            styles.appendTo(node_buffer);
+            out.write(node_buffer.data(), node_buffer.size());
+        }
+        out << documentFooter();
+        out.flush();
+        if (ofs.is_open())
+        {
+            ofs.close();
+            if (ofs.fail())
+                return false;
+        }
+        return !out.fail();
+    }
+
+private:
+    Layout layout;
+    std::vector<char> buffer;
+    std::ofstream ofs;
+    std::ostream out;
+    bool open = false;
+    // Reused for every shape, so serializing does not allocate once it has grown to the largest shape.
+    std::string node_buffer;
+    StyleSheet styles;
+};
 }
 
 #endif
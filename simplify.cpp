@@ -0,0 +1,113 @@
+/*
+ * simplify.cpp
+ *
+ * Reduction of the points of a stroke within an error tolerance.
+ */
+
+#include "simplify.hpp"
+#include <algorithm>
+
+namespace
+{
+/** the widths are optional. If widths is NULL, only the distance of the points is considered.
+ *
+ */
+void simplify_points(std::vector<svg::Point> &points,
+    std::vector<double> *widths,
+    double tolerance,
+    SimplifyScratch &scratch)
+{
+    size_t size = points.size();
+    if (size < 3 || tolerance <= 0)
+    {
+        return;
+    }
+
+    std::vector<char> &keep = scratch.keep;
+    std::vector<std::pair<size_t, size_t>> &ranges = scratch.ranges;
+    keep.assign(size, 0);
+    keep[0] = 1;
+    keep[size - 1] = 1;
+
+    const double tolerance2 = tolerance * tolerance;
+    ranges.clear();
+    ranges.emplace_back(0, size - 1);
+    while (!ranges.empty())
+    {
+        size_t first = ranges.back().first;
+        size_t last = ranges.back().second;
+        ranges.pop_back();
+        if (last - first < 2)
+        {
+            continue;
+        }
+
+        // Squared distance of the points between first and last to the segment from first to last.
+        const svg::Point a = points[first];
+        const double dx = points[last].x - a.x;
+        const double dy = points[last].y - a.y;
+        const double length2 = dx * dx + dy * dy;
+        const double inverse_length2 = length2 > 0 ? 1 / length2 : 0;
+
+        double max_distance2 = 0;
+        size_t max_index = first;
+        for (size_t i = first + 1; i < last; i++)
+        {
+            double px = points[i].x - a.x;
+            double py = points[i].y - a.y;
+            double t = (px * dx + py * dy) * inverse_length2;
+            t = t < 0 ? 0 : (t > 1 ? 1 : t);
+            px -= t * dx;
+            py -= t * dy;
+            double distance2 = px * px + py * py;
+            if (widths != NULL)
+            {
+                const std::vector<double> &w = *widths;
+                double dw = (w[i] - w[first] - t * (w[last] - w[first])) / 2;
+                distance2 = std::max(distance2, dw * dw);
+            }
+            if (distance2 > max_distance2)
+            {
+                max_distance2 = distance2;
+                max_index = i;
+            }
+        }
+
+        if (max_distance2 > tolerance2)
+        {
+            keep[max_index] = 1;
+            ranges.emplace_back(first, max_index);
+            ranges.emplace_back(max_index, last);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (keep[i])
+        {
+            if (widths != NULL)
+            {
+                (*widths)[kept] = (*widths)[i];
+            }
+            points[kept++] = points[i];
+        }
+    }
+    points.resize(kept);
+    if (widths != NULL)
+    {
+        widths->resize(kept);
+    }
+}
+}
+
+void simplify(std::vector<svg::Point> &points, double tolerance, SimplifyScratch &scratch)
+{
+    simplify_points(points, NULL, tolerance, scratch);
+}
+
+void simplify(
+    std::vector<svg::Point> &points, std::vector<double> &widths, double tolerance, SimplifyScratch &scratch)
+{
+    simplify_points(points, widths.size() == points.size() ? &widths : NULL, tolerance, scratch);
+}
@@ -0,0 +1,44 @@
+/*
+ * simplify.hpp
+ *
+ * Reduction of the points of a stroke within an error tolerance.
+ */
+
+#ifndef SIMPLIFY_HPP
+#define SIMPLIFY_HPP
+
+#include "simple_svg_1.0.0.hpp"
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/** scratch space of simplify(), which is reused from stroke to stroke.
+ *
+ */
+struct SimplifyScratch
+{
+    std::vector<char> keep;
+    std::vector<std::pair<size_t, size_t>> ranges;
+};
+
+/** removes points of a stroke with the Ramer-Douglas-Peucker algorithm.
+ *
+ * A point is only removed if it is closer than tolerance to the segment of the simplified stroke that replaces it,
+ * so the simplified stroke deviates at most by tolerance from the original. The first and the last point are kept.
+ * The runtime is O(n log n) for the strokes of handwriting, O(n^2) in the worst case.
+ *
+ * @param tolerance maximal deviation in the units of the points. Nothing is removed for values <= 0.
+ */
+void simplify(std::vector<svg::Point> &points, double tolerance, SimplifyScratch &scratch);
+
+/** simplifies a stroke of variable width, see simplify().
+ *
+ * The widths are removed together with their points. A point is also kept if the outline of the stroke would move by
+ * more than tolerance, which is half of the difference of its width to the width interpolated along the segment.
+ *
+ * @param widths one width for each point.
+ */
+void simplify(
+    std::vector<svg::Point> &points, std::vector<double> &widths, double tolerance, SimplifyScratch &scratch);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * stats.cpp
+ *
+ * Stage times and counters of conversions, reported with --stats.
+ */
+
+#include "stats.hpp"
+#include <cstdio>
+#include <string>
+
+namespace
+{
+double seconds(uint64_t nanoseconds)
+{
+    return nanoseconds / 1e9;
+}
+
+/** amount per second, or 0 if no time was measured.
+ *
+ */
+double rate(double amount, double seconds)
+{
+    return seconds > 0 ? amount / seconds : 0;
+}
+
+/** the time from the decoded strokes to the finished output, over which the output rate is measured.
+ *
+ * An svg is written while the strokes are, a png only after it was rendered, so the stages are taken together.
+ */
+double output_seconds(const ConversionStats &stats)
+{
+    return seconds(stats.stage_nanoseconds[ConversionStats::Write] + stats.stage_nanoseconds[ConversionStats::Raster]
+        + stats.stage_nanoseconds[ConversionStats::Finish]);
+}
+
+std::string format(const char *format, double value)
+{
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), format, value);
+    return buffer;
+}
+}
+
+const char *ConversionStats::stage_name(Stage stage)
+{
+    switch (stage)
+    {
+    case Open:
+        return "open";
+    case Inflate:
+        return "inflate";
+    case Split:
+        return "split";
+    case Decode:
+        return "decode";
+    case Write:
+        return "write";
+    case Raster:
+        return "raster";
+    case Finish:
+        return "finish";
+    default:
+        return "";
+    }
+}
+
+void ConversionStats::add(const ConversionStats &other)
+{
+    for (int stage = 0; stage < StageCount; stage++)
+    {
+        stage_nanoseconds[stage] += other.stage_nanoseconds[stage];
+    }
+    files += other.files;
+    cached_files += other.cached_files;
+    sections += other.sections;
+    compressed_bytes += other.compressed_bytes;
+    inflated_bytes += other.inflated_bytes;
+    strokes += other.strokes;
+    points += other.points;
+    written_points += other.written_points;
+    output_bytes += other.output_bytes;
+}
+
+ConversionStats StatsCollector::snapshot(double &wall_seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return total;
+}
+
+void StatsCollector::print(std::ostream &out)
+{
+    double wall;
+    ConversionStats stats = snapshot(wall);
+
+    uint64_t stage_total = 0;
+    for (int stage = 0; stage < ConversionStats::StageCount; stage++)
+    {
+        stage_total += stats.stage_nanoseconds[stage];
+    }
+    out << "stage      seconds   share\n";
+    for (int stage = 0; stage < ConversionStats::StageCount; stage++)
+    {
+        uint64_t nanoseconds = stats.stage_nanoseconds[stage];
+        const char *name = ConversionStats::stage_name(ConversionStats::Stage(stage));
+        char line[64];
+        std::snprintf(line, sizeof(line), "%-8s %9.4f %6.1f%%\n", name, seconds(nanoseconds),
+            stage_total > 0 ? 100.0 * nanoseconds / stage_total : 0.0);
+        out << line;
+    }
+
+    double inflate = seconds(stats.stage_nanoseconds[ConversionStats::Inflate]);
+    double decode = seconds(stats.stage_nanoseconds[ConversionStats::Decode]);
+    double output = output_seconds(stats);
+    out << "files " << stats.files << " (" << stats.cached_files << " cached), sections " << stats.sections
+        << ", strokes " << stats.strokes << ", points " << stats.points << " (" << stats.written_points
+        << " written)\n"
+        << "compressed " << stats.compressed_bytes << " bytes, inflated " << stats.inflated_bytes
+        << " bytes, output " << stats.output_bytes << " bytes\n"
+        << "wall " << format("%.4f", wall) << " s, " << format("%.0f", rate(stats.points, wall)) << " points/s, "
+        << format("%.0f", rate(stats.strokes, wall)) << " strokes/s\n"
+        << "inflate " << format("%.1f", rate(stats.inflated_bytes / 1e6, inflate)) << " MB/s, decode "
+        << format("%.0f", rate(stats.points, decode)) << " points/s, output "
+        << format("%.1f", rate(stats.output_bytes / 1e6, output)) << " MB/s" << std::endl;
+}
+
+void StatsCollector::print_json(std::ostream &out)
+{
+    double wall;
+    ConversionStats stats = snapshot(wall);
+
+    double inflate = seconds(stats.stage_nanoseconds[ConversionStats::Inflate]);
+    double decode = seconds(stats.stage_nanoseconds[ConversionStats::Decode]);
+    double output = output_seconds(stats);
+    out << "{\"wall_seconds\":" << format("%.6f", wall) << ",\"stage_seconds\":{";
+    for (int stage = 0; stage < ConversionStats::StageCount; stage++)
+    {
+        out << (stage > 0 ? "," : "") << '"' << ConversionStats::stage_name(ConversionStats::Stage(stage))
+            << "\":" << format("%.6f", seconds(stats.stage_nanoseconds[stage]));
+    }
+    out << "},\"files\":" << stats.files << ",\"cached_files\":" << stats.cached_files
+        << ",\"sections\":" << stats.sections << ",\"compressed_bytes\":" << stats.compressed_bytes
+        << ",\"inflated_bytes\":" << stats.inflated_bytes << ",\"strokes\":" << stats.strokes
+        << ",\"points\":" << stats.points << ",\"written_points\":" << stats.written_points
+        << ",\"output_bytes\":" << stats.output_bytes
+        << ",\"points_per_second\":" << format("%.1f", rate(stats.points, wall))
+        << ",\"strokes_per_second\":" << format("%.1f", rate(stats.strokes, wall))
+        << ",\"inflate_mb_per_second\":" << format("%.3f", rate(stats.inflated_bytes / 1e6, inflate))
+        << ",\"decode_points_per_second\":" << format("%.1f", rate(stats.points, decode))
+        << ",\"output_mb_per_second\":" << format("%.3f", rate(stats.output_bytes / 1e6, output)) << "}"
+        << std::endl;
+}
+
+CountingBuf::CountingBuf(std::streambuf *sink, uint64_t &count) : sink(sink), count(count), buffer(1 << 16)
+{
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+bool CountingBuf::flush_buffer()
+{
+    std::streamsize size = pptr() - pbase();
+    bool written = size == 0 || sink->sputn(pbase(), size) == size;
+    count += size;
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return written;
+}
+
+int CountingBuf::overflow(int c)
+{
+    if (!flush_buffer())
+    {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int CountingBuf::sync()
+{
+    return flush_buffer() && sink->pubsync() == 0 ? 0 : -1;
+}
@@ -0,0 +1,152 @@
+/*
+ * stats.hpp
+ *
+ * Stage times and counters of conversions, reported with --stats.
+ */
+
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+/** what the conversion of one or more files did, and where the time went.
+ *
+ * The stage times are summed over all files and threads. With several workers they can add up to more than the wall
+ * time, and show how the work is shared between the stages.
+ */
+struct ConversionStats
+{
+    enum Stage
+    {
+        // opening the archive and reading its central directory.
+        Open,
+        // inflating the media sections.
+        Inflate,
+        // splitting the sections into length prefixed frames.
+        Split,
+        // parsing, simplifying and outlining the strokes, on all decode threads.
+        Decode,
+        // formatting the strokes as svg and writing them to the output, or collecting them for a png.
+        Write,
+        // rasterizing the strokes of a png, on all decode threads.
+        Raster,
+        // writing the end of the document and closing the output.
+        Finish,
+        StageCount
+    };
+
+    static const char *stage_name(Stage stage);
+
+    uint64_t stage_nanoseconds[StageCount] = {};
+    uint64_t files = 0;
+    // files skipped because their svg was current in the cache.
+    uint64_t cached_files = 0;
+    uint64_t sections = 0;
+    // size of the media sections in the archive, and after inflating them.
+    uint64_t compressed_bytes = 0;
+    uint64_t inflated_bytes = 0;
+    uint64_t strokes = 0;
+    // points as decoded, and as written after simplifying and outlining.
+    uint64_t points = 0;
+    uint64_t written_points = 0;
+    // bytes of the output: the svg before a .svgz is compressed, all tiles of -T, or the png of -P.
+    uint64_t output_bytes = 0;
+
+    void add(const ConversionStats &other);
+};
+
+/** adds the time from its construction to its destruction to a stage of stats.
+ *
+ * Without stats the clock is not read at all.
+ */
+class StageTimer
+{
+public:
+    StageTimer(ConversionStats *stats, ConversionStats::Stage stage) : stats(stats), stage(stage)
+    {
+        if (stats != NULL)
+        {
+            start = std::chrono::steady_clock::now();
+        }
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+    ~StageTimer()
+    {
+        if (stats != NULL)
+        {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            stats->stage_nanoseconds[stage] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+    }
+
+private:
+    ConversionStats *stats;
+    ConversionStats::Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+/** the stats of all conversions of a process, to which the conversions of several threads are added.
+ *
+ */
+class StatsCollector
+{
+public:
+    StatsCollector() : started(std::chrono::steady_clock::now())
+    {
+    }
+
+    void add(const ConversionStats &stats)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        total.add(stats);
+    }
+
+    /** writes the stage times, the counters and the rates derived from them as table.
+     *
+     */
+    void print(std::ostream &out);
+
+    /** writes the same as print() as a single JSON object.
+     *
+     */
+    void print_json(std::ostream &out);
+
+private:
+    ConversionStats snapshot(double &wall_seconds);
+
+    std::mutex mutex;
+    ConversionStats total;
+    std::chrono::steady_clock::time_point started;
+};
+
+/** passes everything written to it on to sink, and counts the bytes.
+ *
+ * Writes are collected in a buffer, so counting costs one virtual call per buffer instead of one per write.
+ */
+class CountingBuf : public std::streambuf
+{
+public:
+    CountingBuf(std::streambuf *sink, uint64_t &count);
+    CountingBuf(const CountingBuf &) = delete;
+    CountingBuf &operator=(const CountingBuf &) = delete;
+
+protected:
+    int overflow(int c) override;
+    int sync() override;
+
+private:
+    bool flush_buffer();
+
+    std::streambuf *sink;
+    uint64_t &count;
+    std::vector<char> buffer;
+};
+
+#endif
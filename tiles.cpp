@@ -0,0 +1,265 @@
+/*
+ * tiles.cpp
+ *
+ * Output of a page as a grid of small svg tiles with a JSON manifest.
+ */
+
+#include "tiles.hpp"
+#include "gzip_file.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TileWriter::TileWriter(const std::string &dir,
+    const svg::Layout &layout,
+    double tile_size,
+    bool compress,
+    int compression_level,
+    uint64_t *output_bytes)
+    : dir(dir), layout(layout), tile_size(tile_size), compress(compress), compression_level(compression_level),
+      output_bytes(output_bytes), columns(std::max(1.0, std::ceil(layout.dimensions.width / tile_size))),
+      rows(std::max(1.0, std::ceil(layout.dimensions.height / tile_size))), tiles(columns * rows), failed(false)
+{
+}
+
+bool TileWriter::open()
+{
+    if (tiles.size() > max_tiles)
+    {
+        std::cerr << "a tile size of " << tile_size << " makes " << tiles.size() << " tiles, at most " << max_tiles
+                  << " are supported" << std::endl;
+        return false;
+    }
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+        std::cerr << "error creating tile directory " << dir << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat dir_stat;
+    if (stat(dir.c_str(), &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode))
+    {
+        std::cerr << dir << " is not a directory" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TileWriter::tiles_of(const std::vector<svg::Point> &points,
+    double margin,
+    size_t &first_column,
+    size_t &first_row,
+    size_t &last_column,
+    size_t &last_row) const
+{
+    if (points.empty())
+    {
+        return false;
+    }
+    svg::Point low = points[0];
+    svg::Point high = points[0];
+    for (auto &point : points)
+    {
+        low.x = std::min(low.x, point.x);
+        low.y = std::min(low.y, point.y);
+        high.x = std::max(high.x, point.x);
+        high.y = std::max(high.y, point.y);
+    }
+
+    // Flipped axes swap the corners of the box.
+    double x0 = svg::translateX(low.x - margin, layout);
+    double x1 = svg::translateX(high.x + margin, layout);
+    double y0 = svg::translateY(low.y - margin, layout);
+    double y1 = svg::translateY(high.y + margin, layout);
+    svg::Point min(std::min(x0, x1), std::min(y0, y1));
+    svg::Point max(std::max(x0, x1), std::max(y0, y1));
+
+    if (max.x < 0 || max.y < 0 || min.x > layout.dimensions.width || min.y > layout.dimensions.height)
+    {
+        return false;
+    }
+    auto cell = [this](double value, size_t count) {
+        double index = std::floor(value / tile_size);
+        return size_t(std::min(std::max(index, 0.0), double(count - 1)));
+    };
+    first_column = cell(min.x, columns);
+    first_row = cell(min.y, rows);
+    last_column = cell(max.x, columns);
+    last_row = cell(max.y, rows);
+    return true;
+}
+
+std::string TileWriter::file_name(size_t column, size_t row) const
+{
+    return std::to_string(column) + "_" + std::to_string(row) + (compress ? ".svgz" : ".svg");
+}
+
+svg::StreamingDocument &TileWriter::tile(size_t column, size_t row)
+{
+    Tile &tile = tiles[row * columns + column];
+    if (tile.doc != NULL)
+    {
+        return *tile.doc;
+    }
+
+    svg::Point origin(column * tile_size, row * tile_size);
+    svg::Dimensions size(std::min(tile_size, layout.dimensions.width - origin.x),
+        std::min(tile_size, layout.dimensions.height - origin.y));
+    tile.body.reset(new std::stringbuf(std::ios::out));
+    tile.doc.reset(new svg::StreamingDocument(tile.body.get(), layout, origin, size));
+    return *tile.doc;
+}
+
+bool TileWriter::close()
+{
+    for (size_t row = 0; row < rows; row++)
+    {
+        for (size_t column = 0; column < columns; column++)
+        {
+            Tile &tile = tiles[row * columns + column];
+            if (tile.doc == NULL)
+            {
+                continue;
+            }
+            bool ended = tile.doc->close();
+            std::string body = tile.body->str();
+            // The tile is kept as listed in the manifest, but its svg is not needed any more.
+            tile.body.reset(new std::stringbuf(std::ios::out));
+            if (output_bytes != NULL)
+            {
+                *output_bytes += body.size();
+            }
+            if (!ended || !write_file(file_name(column, row), body, compress))
+            {
+                failed = true;
+            }
+        }
+    }
+    if (failed)
+    {
+        std::cerr << "error writing the tiles of " << dir << std::endl;
+        return false;
+    }
+    if (!write_manifest())
+    {
+        return false;
+    }
+    remove_stale_tiles();
+    return true;
+}
+
+/** writes data to the file name in dir, through a temporary file that is renamed.
+ *
+ * The temporary name is unique to the process and the call, so writers of the same directory do not meet.
+ *
+ * @param gzip compresses data with compression_level.
+ */
+bool TileWriter::write_file(const std::string &name, const std::string &data, bool gzip) const
+{
+    static std::atomic<unsigned long> next_temporary(0);
+    std::string path = dir + "/" + name;
+    std::string temporary =
+        dir + "/." + name + "." + std::to_string(getpid()) + "." + std::to_string(next_temporary++) + ".tmp";
+    bool written;
+    if (gzip)
+    {
+        GzipFileBuf file;
+        written = file.open(temporary, compression_level)
+            && file.sputn(data.data(), data.size()) == std::streamsize(data.size());
+        written = file.close() && written;
+    }
+    else
+    {
+        std::filebuf file;
+        written = file.open(temporary, std::ios::out | std::ios::trunc) != NULL
+            && file.sputn(data.data(), data.size()) == std::streamsize(data.size());
+        written = file.close() != NULL && written;
+    }
+    if (!written || std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        std::cerr << "error writing " << path << std::endl;
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+/** removes the files named like tiles, column_row.svg or .svgz, that the manifest does not list.
+ *
+ * They are left by an earlier conversion with other strokes, another tile size or another compression.
+ */
+void TileWriter::remove_stale_tiles() const
+{
+    DIR *directory = opendir(dir.c_str());
+    if (directory == NULL)
+    {
+        return;
+    }
+    while (struct dirent *entry = readdir(directory))
+    {
+        const char *name = entry->d_name;
+        if (!std::isdigit((unsigned char) name[0]))
+        {
+            continue;
+        }
+        char *end;
+        errno = 0;
+        unsigned long column = std::strtoul(name, &end, 10);
+        if (errno != 0 || *end != '_' || !std::isdigit((unsigned char) end[1]))
+        {
+            continue;
+        }
+        unsigned long row = std::strtoul(end + 1, &end, 10);
+        if (errno != 0 || (std::strcmp(end, ".svg") != 0 && std::strcmp(end, ".svgz") != 0))
+        {
+            continue;
+        }
+        bool listed = column < columns && row < rows && tiles[row * columns + column].doc != NULL
+            && name == file_name(column, row);
+        if (!listed && unlink((dir + "/" + name).c_str()) != 0)
+        {
+            std::cerr << "error removing the stale tile " << dir << "/" << name << std::endl;
+        }
+    }
+    closedir(directory);
+}
+
+bool TileWriter::write_manifest()
+{
+    std::string manifest;
+    manifest += "{\"version\":1,\"width\":";
+    svg::appendNumber(manifest, layout.dimensions.width);
+    manifest += ",\"height\":";
+    svg::appendNumber(manifest, layout.dimensions.height);
+    manifest += ",\"tile_size\":";
+    svg::appendNumber(manifest, tile_size);
+    manifest += ",\"columns\":" + std::to_string(columns) + ",\"rows\":" + std::to_string(rows) + ",\"tiles\":[";
+    bool first = true;
+    for (size_t row = 0; row < rows; row++)
+    {
+        for (size_t column = 0; column < columns; column++)
+        {
+            const Tile &tile = tiles[row * columns + column];
+            if (tile.doc == NULL)
+            {
+                continue;
+            }
+            manifest += first ? "" : ",";
+            first = false;
+            manifest += "{\"column\":" + std::to_string(column) + ",\"row\":" + std::to_string(row) + ",\"file\":\""
+                + file_name(column, row) + "\",\"strokes\":" + std::to_string(tile.strokes) + "}";
+        }
+    }
+    manifest += "]}\n";
+
+    return write_file("manifest.json", manifest, false);
+}
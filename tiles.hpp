@@ -0,0 +1,117 @@
+/*
+ * tiles.hpp
+ *
+ * Output of a page as a grid of small svg tiles with a JSON manifest.
+ */
+
+#ifndef TILES_HPP
+#define TILES_HPP
+
+#include "simple_svg_1.0.0.hpp"
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/** writes the strokes of a page into a directory of tiles.
+ *
+ * The page is split into a grid of square tiles of tile_size svg units, the tiles at the right and bottom edge are
+ * smaller. The grid is the spatial index: a stroke goes into every tile its bounding box overlaps, so a viewer gets
+ * all strokes of a region from the tiles that cover it. Each tile is an svg document with a viewBox on its part of
+ * the page, named column_row.svg, or .svgz if compressed.
+ *
+ * Tiles are only created once a stroke falls into them. Their svg is collected in memory, and close() writes one tile
+ * after the other, so a page of many tiles does not hold a file or a deflate stream per tile. Afterwards it writes
+ * manifest.json with the page, the grid and the tiles that have strokes, and removes the tiles of an earlier
+ * conversion that it does not list.
+ *
+ * Each file is written to a temporary name of its own and renamed, so a viewer reads either the old or the complete
+ * new file, even while the directory is converted again.
+ */
+class TileWriter
+{
+public:
+    /**
+     * @param compress write the tiles gzip compressed as .svgz, with compression_level from 0 to 9 or -1 for the
+     * default of zlib.
+     * @param output_bytes counts the svg written to all tiles, before they are compressed, or NULL.
+     */
+    TileWriter(const std::string &dir,
+        const svg::Layout &layout,
+        double tile_size,
+        bool compress,
+        int compression_level,
+        uint64_t *output_bytes = NULL);
+    TileWriter(const TileWriter &) = delete;
+    TileWriter &operator=(const TileWriter &) = delete;
+
+    /** limits the files a small tile size creates.
+     *
+     */
+    static const size_t max_tiles = 65536;
+
+    /** creates the directory.
+     *
+     * @return false if it does not exist and can not be created, or the grid has more than max_tiles tiles.
+     */
+    bool open();
+
+    /** the range of tiles the bounding box of points overlaps.
+     *
+     * @param margin added around the box in user units, like half the width of the pen.
+     * @return false if the box is outside the page.
+     */
+    bool tiles_of(const std::vector<svg::Point> &points,
+        double margin,
+        size_t &first_column,
+        size_t &first_row,
+        size_t &last_column,
+        size_t &last_row) const;
+
+    /** the document of a tile, which is created with the first stroke written to it.
+     *
+     */
+    svg::StreamingDocument &tile(size_t column, size_t row);
+
+    /** counts a stroke written to the tile.
+     *
+     */
+    void count_stroke(size_t column, size_t row)
+    {
+        tiles[row * columns + column].strokes++;
+    }
+
+    /** ends all tiles and writes the manifest.
+     *
+     * @return false if a tile or the manifest could not be written.
+     */
+    bool close();
+
+private:
+    struct Tile
+    {
+        // the svg of the tile, until close() writes it.
+        std::unique_ptr<std::stringbuf> body;
+        std::unique_ptr<svg::StreamingDocument> doc;
+        size_t strokes = 0;
+    };
+
+    std::string file_name(size_t column, size_t row) const;
+    bool write_file(const std::string &name, const std::string &data, bool gzip) const;
+    bool write_manifest();
+    void remove_stale_tiles() const;
+
+    std::string dir;
+    svg::Layout layout;
+    double tile_size;
+    bool compress;
+    int compression_level;
+    uint64_t *output_bytes;
+    size_t columns;
+    size_t rows;
+    std::vector<Tile> tiles;
+    bool failed;
+};
+
+#endif
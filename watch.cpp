@@ -0,0 +1,307 @@
+/*
+ * watch.cpp
+ *
+ * Conversion of the .will files, that are written into a directory.
+ */
+
+#include "watch.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+bool is_will_file(const std::string &name)
+{
+    return name.size() > 5 && name.compare(name.size() - 5, 5, ".will") == 0;
+}
+
+// Files are only converted, once they are complete. Directories are watched for new files and subdirectories.
+const uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_CREATE | IN_ONLYDIR;
+}
+
+DirectoryWatcher::DirectoryWatcher(Handler handler, unsigned int workers, unsigned int debounce_milliseconds)
+    : handler(handler), debounce(debounce_milliseconds), inotify_fd(-1), closing(false)
+{
+    stop_pipe[0] = -1;
+    stop_pipe[1] = -1;
+    for (unsigned int i = 0; i < std::max(workers, 1u); i++)
+    {
+        this->workers.emplace_back(&DirectoryWatcher::work, this);
+    }
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        closing = true;
+    }
+    queue_changed.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    for (int fd : {inotify_fd, stop_pipe[0], stop_pipe[1]})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+}
+
+bool DirectoryWatcher::watch(const std::string &dir)
+{
+    if (inotify_fd < 0)
+    {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0 || pipe(stop_pipe) != 0)
+        {
+            std::cerr << "error initializing inotify: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+    }
+
+    size_t watched = directories.size();
+    add_watches(dir, false);
+    return directories.size() > watched;
+}
+
+void DirectoryWatcher::add_watches(const std::string &dir, bool convert_files)
+{
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(), watch_mask);
+    if (wd < 0)
+    {
+        std::cerr << "error watching " << dir << ": " << std::strerror(errno) << std::endl;
+        return;
+    }
+    directories[wd] = dir;
+
+    DIR *handle = opendir(dir.c_str());
+    if (handle == NULL)
+    {
+        return;
+    }
+    std::vector<std::string> subdirectories;
+    while (struct dirent *entry = readdir(handle))
+    {
+        std::string name(entry->d_name);
+        if (name == "." || name == "..")
+        {
+            continue;
+        }
+        std::string path = dir + "/" + name;
+        struct stat path_stat;
+        if (lstat(path.c_str(), &path_stat) != 0)
+        {
+            continue;
+        }
+        if (S_ISDIR(path_stat.st_mode))
+        {
+            subdirectories.push_back(path);
+        }
+        else if (convert_files && S_ISREG(path_stat.st_mode) && is_will_file(name))
+        {
+            settle(path);
+        }
+    }
+    closedir(handle);
+
+    for (auto &subdirectory : subdirectories)
+    {
+        add_watches(subdirectory, convert_files);
+    }
+}
+
+void DirectoryWatcher::settle(const std::string &will_file_name)
+{
+    settling[will_file_name] = Clock::now() + debounce;
+}
+
+void DirectoryWatcher::read_events()
+{
+    alignas(inotify_event) char buffer[1 << 16];
+    while (true)
+    {
+        ssize_t size = read(inotify_fd, buffer, sizeof(buffer));
+        if (size <= 0)
+        {
+            return;
+        }
+
+        for (char *pos = buffer; pos < buffer + size;)
+        {
+            const inotify_event *event = (const inotify_event *) pos;
+            pos += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                std::cerr << "too many changes at once, some files were missed" << std::endl;
+                continue;
+            }
+            if (event->mask & IN_IGNORED)
+            {
+                directories.erase(event->wd);
+                continue;
+            }
+            auto dir = directories.find(event->wd);
+            if (dir == directories.end() || event->len == 0)
+            {
+                continue;
+            }
+            std::string name(event->name);
+            std::string path = dir->second + "/" + name;
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    add_watches(path, true);
+                }
+            }
+            else if (!is_will_file(name))
+            {
+                continue;
+            }
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+            {
+                settle(path);
+            }
+            else if (event->mask & IN_MODIFY)
+            {
+                // A file, that is written again before it is due, waits for the next close.
+                settling.erase(path);
+            }
+        }
+    }
+}
+
+void DirectoryWatcher::run()
+{
+    if (inotify_fd < 0)
+    {
+        return;
+    }
+
+    while (true)
+    {
+        int timeout = -1;
+        if (!settling.empty())
+        {
+            auto due = Clock::now() + std::chrono::hours(1);
+            for (auto &file : settling)
+            {
+                due = std::min(due, file.second);
+            }
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now());
+            timeout = std::max<int>(wait.count() + 1, 0);
+        }
+
+        pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR)
+        {
+            std::cerr << "error waiting for changes: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (fds[1].revents)
+        {
+            break;
+        }
+        if (fds[0].revents)
+        {
+            read_events();
+        }
+
+        auto now = Clock::now();
+        for (auto file = settling.begin(); file != settling.end();)
+        {
+            if (file->second <= now)
+            {
+                enqueue(file->first);
+                file = settling.erase(file);
+            }
+            else
+            {
+                ++file;
+            }
+        }
+    }
+
+    // The files, that are already queued, are still converted.
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_changed.wait(lock, [this]() { return queue.empty() && converting.empty(); });
+}
+
+void DirectoryWatcher::stop()
+{
+    if (stop_pipe[1] >= 0)
+    {
+        char stop = 1;
+        ssize_t written = write(stop_pipe[1], &stop, 1);
+        (void) written;
+    }
+}
+
+void DirectoryWatcher::enqueue(const std::string &will_file_name)
+{
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (queued.count(will_file_name))
+        {
+            return;
+        }
+        if (converting.count(will_file_name))
+        {
+            written_again.insert(will_file_name);
+            return;
+        }
+        queue.push_back(will_file_name);
+        queued.insert(will_file_name);
+    }
+    queue_changed.notify_all();
+}
+
+void DirectoryWatcher::work()
+{
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true)
+    {
+        queue_changed.wait(lock, [this]() { return !queue.empty() || closing; });
+        if (queue.empty())
+        {
+            return;
+        }
+        std::string will_file_name = queue.front();
+        queue.pop_front();
+        queued.erase(will_file_name);
+        converting.insert(will_file_name);
+
+        lock.unlock();
+        try
+        {
+            handler(will_file_name);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "error converting " << will_file_name << ": " << e.what() << std::endl;
+        }
+        lock.lock();
+
+        converting.erase(will_file_name);
+        if (written_again.erase(will_file_name))
+        {
+            queue.push_back(will_file_name);
+            queued.insert(will_file_name);
+        }
+        queue_changed.notify_all();
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ * watch.hpp
+ *
+ * Conversion of the .will files, that are written into a directory.
+ */
+
+#ifndef WATCH_HPP
+#define WATCH_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/** watches a directory tree with inotify, and hands each .will file to a pool of workers once it is written.
+ *
+ * A file is due when it was closed after writing or moved into the tree, and then was left alone for the debounce
+ * time. Files already in the tree are not converted, and the tree is never scanned again after watch(). Only
+ * directories that appear later are scanned once, for the .will files they brought along.
+ *
+ * A file is queued only once, however often it is written. If it is written again while it is converted, it is
+ * converted again afterwards.
+ */
+class DirectoryWatcher
+{
+public:
+    typedef std::function<void(const std::string &will_file_name)> Handler;
+
+    /** the handler is called on the worker threads, for one file at a time on each.
+     *
+     */
+    DirectoryWatcher(Handler handler, unsigned int workers, unsigned int debounce_milliseconds = 500);
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+    ~DirectoryWatcher();
+
+    /** watches dir and all directories below it.
+     *
+     * @return false if inotify is not available or dir can not be watched.
+     */
+    bool watch(const std::string &dir);
+
+    /** handles the changes of the tree until stop() is called. Returns after the queued files are converted.
+     *
+     */
+    void run();
+
+    /** lets run() return. Only writes to a pipe, so it can be called from a signal handler.
+     *
+     */
+    void stop();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void add_watches(const std::string &dir, bool convert_files);
+    void read_events();
+    void settle(const std::string &will_file_name);
+    void enqueue(const std::string &will_file_name);
+    void work();
+
+    Handler handler;
+    std::chrono::milliseconds debounce;
+    int inotify_fd;
+    int stop_pipe[2];
+    // watched directories by watch descriptor.
+    std::unordered_map<int, std::string> directories;
+    // files waiting for the debounce time to pass, with the time they are due.
+    std::map<std::string, Clock::time_point> settling;
+
+    // the worker pool and its queue.
+    std::vector<std::thread> workers;
+    std::deque<std::string> queue;
+    std::set<std::string> queued;
+    std::set<std::string> converting;
+    std::set<std::string> written_again;
+    std::mutex queue_mutex;
+    std::condition_variable queue_changed;
+    bool closing;
+};
+
+#endif
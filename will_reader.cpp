@@ -0,0 +1,387 @@
+/*
+ * will_reader.cpp
+ *
+ * libwill: reads the strokes of .will files, without any svg involved.
+ */
+
+#include "will_reader.hpp"
+#include "delta_decode.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+uint64_t getLength(const unsigned char *&pos, const unsigned char *end)
+{
+    uint64_t len = 0;
+    for (size_t i = 0; i < 10 && pos < end; i++)
+    {
+        unsigned char data = *pos++;
+        len |= uint64_t(data & 127) << (7 * i);
+        // If the next-byte flag is set
+        if (!(data & 128))
+        {
+            break;
+        }
+    }
+
+    return len;
+}
+
+bool read_entry(zip_t *archive, zip_uint64_t index, const zip_stat_t &stat, std::vector<unsigned char> &buffer)
+{
+    if (!(stat.valid & ZIP_STAT_SIZE) || !(stat.valid & ZIP_STAT_COMP_SIZE))
+    {
+        return false;
+    }
+    if (stat.size > max_inflated_size(stat.comp_size))
+    {
+        std::cerr << "impossible size of " << stat.name << " in will." << std::endl;
+        return false;
+    }
+    zip_file_t *file = zip_fopen_index(archive, index, 0);
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    buffer.resize(stat.size);
+    zip_uint64_t read = 0;
+    while (read < stat.size)
+    {
+        zip_int64_t n = zip_fread(file, buffer.data() + read, stat.size - read);
+        if (n <= 0)
+        {
+            break;
+        }
+        read += n;
+    }
+    zip_fclose(file);
+
+    return read == stat.size;
+}
+
+void split_frames(const unsigned char *data, size_t size, std::vector<Frame> &frames)
+{
+    frames.clear();
+    const unsigned char *pos = data;
+    const unsigned char *end = data + size;
+    while (pos < end)
+    {
+        auto len = getLength(pos, end);
+        if (len == 0)
+        {
+            break;
+        }
+        if (len > uint64_t(end - pos))
+        {
+            std::cerr << "truncated stroke in will." << std::endl;
+            break;
+        }
+        frames.push_back(Frame{pos, (uint) len});
+        pos += len;
+    }
+}
+
+bool is_media_section(const std::string &file_name)
+{
+    return file_name.find(".protobuf") != std::string::npos && file_name.find("sections/media") != std::string::npos;
+}
+
+void print_zip_error(const std::string &will_file_name, int error)
+{
+    std::cerr << "error opening will file " << will_file_name << ". Libzip says: " << error << ":";
+    switch (error)
+    {
+    case ZIP_ER_EXISTS:
+        std::cerr << "ZIP_ER_EXISTS" << std::endl;
+        break;
+    case ZIP_ER_INCONS:
+        std::cerr << "ZIP_ER_INCONS" << std::endl;
+        break;
+    case ZIP_ER_INVAL:
+        std::cerr << "ZIP_ER_INVAL" << std::endl;
+        break;
+    case ZIP_ER_MEMORY:
+        std::cerr << "ZIP_ER_MEMORY" << std::endl;
+        break;
+    case ZIP_ER_NOENT:
+        std::cerr << "ZIP_ER_NOENT" << std::endl;
+        break;
+    case ZIP_ER_NOZIP:
+        std::cerr << "ZIP_ER_NOZIP" << std::endl;
+        break;
+    case ZIP_ER_OPEN:
+        std::cerr << "ZIP_ER_OPEN" << std::endl;
+        break;
+    case ZIP_ER_READ:
+        std::cerr << "ZIP_ER_READ" << std::endl;
+        break;
+    case ZIP_ER_SEEK:
+        std::cerr << "ZIP_ER_SEEK" << std::endl;
+        break;
+    default:
+        std::cerr << std::endl;
+        break;
+    }
+}
+
+bool PathParser::parse(const unsigned char *data, size_t len, PathData &path)
+{
+    return decode_path(data, len, path);
+}
+
+void decode_widths(const PathData &path, std::vector<double> &widths)
+{
+    const double divisor = std::pow(10.0, path.decimal_precision);
+
+    widths.resize(path.stroke_width.size());
+    uint32_t width = 0;
+    for (size_t i = 0; i < path.stroke_width.size(); i++)
+    {
+        width += path.stroke_width[i];
+        widths[i] = int32_t(width) / divisor;
+    }
+}
+
+bool decode_color(const PathData &path, StrokeColor &color)
+{
+    const std::vector<int32_t> &values = path.stroke_color;
+    if (values.size() >= 4)
+    {
+        auto channel = [](int32_t value) { return uint8_t(std::min(std::max(value, 0), 255)); };
+        color.red = channel(values[0]);
+        color.green = channel(values[1]);
+        color.blue = channel(values[2]);
+        color.alpha = channel(values[3]);
+        return true;
+    }
+    if (values.size() == 1)
+    {
+        uint32_t rgba = values[0];
+        color.red = rgba >> 24;
+        color.green = (rgba >> 16) & 0xff;
+        color.blue = (rgba >> 8) & 0xff;
+        color.alpha = rgba & 0xff;
+        return true;
+    }
+    return false;
+}
+
+bool StrokeDecoder::decode(const unsigned char *data, size_t len, StrokeView &stroke, bool widths)
+{
+    bool ok = parser.parse(data, len, path_);
+
+    // A trailing x without y is dropped.
+    size_t count = path_.points.size() & ~1;
+    points.resize(count);
+    if (count > 0)
+    {
+        delta_decode(path_.points.data(), count, std::pow(10.0, path_.decimal_precision), points.data());
+    }
+    if (widths)
+    {
+        decode_widths(path_, this->widths);
+    }
+    else
+    {
+        this->widths.clear();
+    }
+
+    stroke.points = points.data();
+    stroke.point_count = count / 2;
+    stroke.widths = this->widths.data();
+    stroke.width_count = this->widths.size();
+    stroke.color = StrokeColor();
+    stroke.has_color = decode_color(path_, stroke.color);
+    stroke.decimal_precision = path_.decimal_precision;
+    stroke.start_parameter = path_.start_parameter;
+    stroke.end_parameter = path_.end_parameter;
+    return ok;
+}
+
+WillArchive::~WillArchive()
+{
+    if (zip != NULL)
+    {
+        zip_close(zip);
+    }
+}
+
+bool WillArchive::open(const std::string &file_name, bool mmap)
+{
+    if (mmap)
+    {
+        if (!mapped.open(file_name))
+        {
+            std::cerr << "error opening will file " << file_name << ": " << mapped.error() << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        int error;
+        zip = zip_open(file_name.c_str(), ZIP_RDONLY, &error);
+        if (zip == NULL)
+        {
+            print_zip_error(file_name, error);
+            return false;
+        }
+    }
+    list_sections();
+    return true;
+}
+
+bool WillArchive::open(const unsigned char *data, size_t size, bool mmap, const std::string &name)
+{
+    if (mmap)
+    {
+        if (!mapped.open(data, size))
+        {
+            std::cerr << "error opening will file " << name << ": " << mapped.error() << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        zip_error_t error;
+        zip_error_init(&error);
+        zip_source_t *source = zip_source_buffer_create(data, size, 0, &error);
+        if (source != NULL)
+        {
+            zip = zip_open_from_source(source, ZIP_RDONLY, &error);
+            if (zip == NULL)
+            {
+                zip_source_free(source);
+            }
+        }
+        if (zip == NULL)
+        {
+            print_zip_error(name, zip_error_code_zip(&error));
+            zip_error_fini(&error);
+            return false;
+        }
+        zip_error_fini(&error);
+    }
+    list_sections();
+    return true;
+}
+
+void WillArchive::list_sections()
+{
+    sections_.clear();
+    if (zip == NULL)
+    {
+        const std::vector<MappedArchive::Entry> &entries = mapped.entries();
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (is_media_section(entries[i].name))
+            {
+                sections_.push_back(Section{entries[i].name, i, entries[i].compressed_size, entries[i].size});
+            }
+        }
+        return;
+    }
+
+    zip_stat_t stat;
+    for (zip_uint64_t i = 0; zip_stat_index(zip, i, 0, &stat) == 0; i++)
+    {
+        if (is_media_section(stat.name))
+        {
+            sections_.push_back(Section{stat.name, i, stat.comp_size, stat.size});
+        }
+    }
+}
+
+bool WillArchive::read(const Section &section,
+    std::vector<unsigned char> &buffer,
+    const unsigned char *&data,
+    size_t &size)
+{
+    if (zip == NULL)
+    {
+        return mapped.read(mapped.entries()[section.index], buffer, data, size);
+    }
+
+    zip_stat_t stat;
+    if (zip_stat_index(zip, section.index, 0, &stat) != 0 || !read_entry(zip, section.index, stat, buffer))
+    {
+        return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+std::string WillArchive::error() const
+{
+    return zip == NULL ? mapped.error() : "libzip could not inflate the entry";
+}
+
+bool visit_section(const unsigned char *data, size_t size, StrokeDecoder &decoder, StrokeVisitor &visitor)
+{
+    // The frames are decoded as they are found, so no list of them is built.
+    StrokeView stroke;
+    const unsigned char *pos = data;
+    const unsigned char *end = data + size;
+    while (pos < end)
+    {
+        auto len = getLength(pos, end);
+        if (len == 0)
+        {
+            break;
+        }
+        if (len > uint64_t(end - pos))
+        {
+            std::cerr << "truncated stroke in will." << std::endl;
+            break;
+        }
+        if (!decoder.decode(pos, len, stroke))
+        {
+            std::cerr << "Failed to parse will." << std::endl;
+        }
+        else if (!visitor.stroke(stroke))
+        {
+            return false;
+        }
+        pos += len;
+    }
+    return true;
+}
+
+namespace
+{
+bool visit_archive(WillArchive &archive, StrokeVisitor &visitor)
+{
+    StrokeDecoder decoder;
+    std::vector<unsigned char> buffer;
+    for (auto &section : archive.sections())
+    {
+        const unsigned char *data;
+        size_t size;
+        if (!archive.read(section, buffer, data, size))
+        {
+            std::cerr << "error reading " << section.name << ": " << archive.error() << std::endl;
+            continue;
+        }
+        visitor.begin_section(section.name);
+        if (!visit_section(data, size, decoder, visitor))
+        {
+            break;
+        }
+        visitor.end_section(section.name);
+    }
+    return true;
+}
+}
+
+bool visit_will_file(const std::string &file_name, StrokeVisitor &visitor, bool mmap)
+{
+    WillArchive archive;
+    return archive.open(file_name, mmap) && visit_archive(archive, visitor);
+}
+
+bool visit_will_data(const unsigned char *data, size_t size, StrokeVisitor &visitor, bool mmap)
+{
+    WillArchive archive;
+    return archive.open(data, size, mmap, "data") && visit_archive(archive, visitor);
+}
@@ -0,0 +1,266 @@
+/*
+ * will_reader.hpp
+ *
+ * libwill: reads the strokes of .will files, without any svg involved.
+ */
+
+#ifndef WILL_READER_HPP
+#define WILL_READER_HPP
+
+#include "path_decoder.hpp"
+#include "zip_reader.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <zip.h>
+
+/** parse the length of the following protobuf stuff
+ *
+ * This function reads a varint of up to 10 Byte and calculates the length of the following protobuf section.
+ * It sets pos to the end of the parsed number.
+ *
+ * @param pos position of the varint in the buffer.
+ * @param end end of the buffer. Nothing behind it is read.
+ *
+ */
+uint64_t getLength(const unsigned char *&pos, const unsigned char *end);
+
+/** reads the whole entry index of the archive into buffer.
+ *
+ * The entry is inflated with as few reads as possible, into a buffer sized from the uncompressed size in stat. The
+ * buffer can be reused for the next entry.
+ *
+ * @return false if the entry could not be opened or read completely, or its uncompressed size is more than it can
+ * inflate to, see max_inflated_size().
+ */
+bool read_entry(zip_t *archive, zip_uint64_t index, const zip_stat_t &stat, std::vector<unsigned char> &buffer);
+
+/** a single length prefixed protobuf message of a media section.
+ *
+ */
+struct Frame
+{
+    const unsigned char *data;
+    uint len;
+};
+
+/** splits a media section into its length prefixed frames.
+ *
+ * The frames point into data. Splitting stops at a zero length or at a frame that exceeds the section.
+ *
+ * @param frames is cleared and receives the frames.
+ */
+void split_frames(const unsigned char *data, size_t size, std::vector<Frame> &frames);
+
+bool is_media_section(const std::string &file_name);
+
+/** prints the libzip error code returned by zip_open() in a human readable way.
+ *
+ */
+void print_zip_error(const std::string &will_file_name, int error);
+
+/** parses serialized WacomInkFormat::Path messages with decode_path().
+ *
+ * The repeated fields of the path keep their capacity from stroke to stroke, so parsing does not allocate once it has
+ * seen the largest stroke. libprotobuf is only used to check decode_path() against, see path_decoder_test.cpp.
+ */
+class PathParser
+{
+public:
+    /** parses the message in data into path.
+     *
+     * @return false if data is not a valid message.
+     */
+    bool parse(const unsigned char *data, size_t len, PathData &path);
+};
+
+/** decodes the widths of path.
+ *
+ * The widths are delta encoded with the decimal precision of the points. A single width is the width of the whole
+ * stroke.
+ */
+void decode_widths(const PathData &path, std::vector<double> &widths);
+
+/** a color of a stroke, with channels from 0 to 255.
+ *
+ */
+struct StrokeColor
+{
+    uint8_t red = 0;
+    uint8_t green = 0;
+    uint8_t blue = 0;
+    uint8_t alpha = 255;
+};
+
+/** decodes the color of path.
+ *
+ * The color is either a single value 0xRRGGBBAA, or the four values red, green, blue and alpha from 0 to 255.
+ *
+ * @return false if the path has no color.
+ */
+bool decode_color(const PathData &path, StrokeColor &color);
+
+/** a decoded stroke, lent to a StrokeVisitor.
+ *
+ * The arrays belong to the decoder, and are only valid until the visitor returns.
+ */
+struct StrokeView
+{
+    // x/y pairs of the points, in the units of the file.
+    const double *points = NULL;
+    size_t point_count = 0;
+    // no width, a single width of the whole stroke, or one width per point.
+    const double *widths = NULL;
+    size_t width_count = 0;
+    bool has_color = false;
+    StrokeColor color;
+    uint32_t decimal_precision = 2;
+    float start_parameter = 0;
+    float end_parameter = 1;
+};
+
+/** receives the strokes of a .will file, one at a time.
+ *
+ */
+class StrokeVisitor
+{
+public:
+    virtual ~StrokeVisitor() = default;
+
+    /** called before the strokes of each media section.
+     *
+     */
+    virtual void begin_section(const std::string &name)
+    {
+        (void) name;
+    }
+
+    /** called for each stroke, in the order of the file.
+     *
+     * @return false to stop reading.
+     */
+    virtual bool stroke(const StrokeView &stroke) = 0;
+
+    /** called after the strokes of each media section, unless reading was stopped.
+     *
+     */
+    virtual void end_section(const std::string &name)
+    {
+        (void) name;
+    }
+};
+
+/** decodes serialized strokes into a StrokeView.
+ *
+ * The buffers of the decoder are reused, so in steady state decoding does not allocate.
+ */
+class StrokeDecoder
+{
+public:
+    /** decodes the stroke in data. The arrays of stroke point into the decoder until the next call.
+     *
+     * @param widths also decode the widths. Without them, stroke has no widths.
+     * @return false if data is not a valid stroke.
+     */
+    bool decode(const unsigned char *data, size_t len, StrokeView &stroke, bool widths = true);
+
+    /** the raw fields of the stroke decoded last.
+     *
+     */
+    const PathData &path() const
+    {
+        return path_;
+    }
+
+private:
+    PathParser parser;
+    PathData path_;
+    std::vector<double> points;
+    std::vector<double> widths;
+};
+
+/** a .will file opened either with libzip or, to read only the pages it needs, from a memory mapping.
+ *
+ */
+class WillArchive
+{
+public:
+    /** a media section of the archive.
+     *
+     */
+    struct Section
+    {
+        std::string name;
+        uint64_t index;
+        uint64_t compressed_size;
+        uint64_t size;
+    };
+
+    WillArchive() = default;
+    WillArchive(const WillArchive &) = delete;
+    WillArchive &operator=(const WillArchive &) = delete;
+    ~WillArchive();
+
+    /** opens the .will file file_name. Errors are reported on std::cerr.
+     *
+     * @param mmap read the file from a memory mapping instead of with libzip.
+     */
+    bool open(const std::string &file_name, bool mmap);
+
+    /** opens the .will file in data, which has to outlive this. Errors are reported on std::cerr.
+     *
+     * @param name of the file in error messages.
+     */
+    bool open(const unsigned char *data, size_t size, bool mmap, const std::string &name);
+
+    /** the media sections in the order of the archive.
+     *
+     */
+    const std::vector<Section> &sections() const
+    {
+        return sections_;
+    }
+
+    /** gets the uncompressed content of section.
+     *
+     * @param buffer receives the content if it has to be inflated. It can be reused for the next section.
+     * @param data set to the content, either in the mapping or in buffer.
+     * @return false if the section can not be read, see error().
+     */
+    bool read(const Section &section, std::vector<unsigned char> &buffer, const unsigned char *&data, size_t &size);
+
+    /** the reason the last read() failed.
+     *
+     */
+    std::string error() const;
+
+private:
+    void list_sections();
+
+    zip_t *zip = NULL;
+    MappedArchive mapped;
+    std::vector<Section> sections_;
+};
+
+/** hands the strokes of a media section to visitor, without storing them.
+ *
+ * @return false if the visitor stopped reading.
+ */
+bool visit_section(const unsigned char *data, size_t size, StrokeDecoder &decoder, StrokeVisitor &visitor);
+
+/** hands the strokes of all media sections of a .will file to visitor.
+ *
+ * Only one media section is held in memory at a time, and no stroke is kept after the visitor returned.
+ *
+ * @param mmap read the file from a memory mapping instead of with libzip.
+ * @return false if the file can not be read. Stopping in the visitor is no error.
+ */
+bool visit_will_file(const std::string &file_name, StrokeVisitor &visitor, bool mmap = false);
+
+/** like visit_will_file(), for a .will file held in memory.
+ *
+ */
+bool visit_will_data(const unsigned char *data, size_t size, StrokeVisitor &visitor, bool mmap = false);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * zip_reader.cpp
+ *
+ * Minimal reader for the zip archives of .will files, working on a memory mapping.
+ */
+
+#include "zip_reader.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace
+{
+const uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+const uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+const uint32_t END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+const size_t LOCAL_HEADER_SIZE = 30;
+const size_t CENTRAL_HEADER_SIZE = 46;
+const size_t END_OF_CENTRAL_DIRECTORY_SIZE = 22;
+
+const uint16_t METHOD_STORED = 0;
+const uint16_t METHOD_DEFLATED = 8;
+
+inline uint16_t read16(const unsigned char *pos)
+{
+    return uint16_t(pos[0] | pos[1] << 8);
+}
+
+inline uint32_t read32(const unsigned char *pos)
+{
+    return uint32_t(pos[0]) | uint32_t(pos[1]) << 8 | uint32_t(pos[2]) << 16 | uint32_t(pos[3]) << 24;
+}
+}
+
+MappedArchive::~MappedArchive()
+{
+    unmap();
+}
+
+void MappedArchive::unmap()
+{
+    if (mapping_ != NULL)
+    {
+        munmap(mapping_, size_);
+        mapping_ = NULL;
+    }
+    data_ = NULL;
+    size_ = 0;
+    entries_.clear();
+}
+
+bool MappedArchive::fail(const std::string &message)
+{
+    error_ = message;
+    return false;
+}
+
+bool MappedArchive::open(const std::string &file_name)
+{
+    unmap();
+
+    int fd = ::open(file_name.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return fail("can not open file");
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0)
+    {
+        close(fd);
+        return fail("can not stat file");
+    }
+    if (file_stat.st_size == 0)
+    {
+        close(fd);
+        return fail("not a zip archive");
+    }
+
+    void *mapping = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return fail("can not map file");
+    }
+
+    if (!open((const unsigned char *) mapping, file_stat.st_size))
+    {
+        munmap(mapping, file_stat.st_size);
+        return false;
+    }
+    mapping_ = mapping;
+    return true;
+}
+
+bool MappedArchive::open(const unsigned char *data, size_t size)
+{
+    unmap();
+
+    if (size < END_OF_CENTRAL_DIRECTORY_SIZE)
+    {
+        return fail("not a zip archive");
+    }
+
+    // The end of central directory record is followed by a comment of up to 64 KiB.
+    const unsigned char *end_record = NULL;
+    size_t search_end = 0;
+    if (size > END_OF_CENTRAL_DIRECTORY_SIZE + 0xffff)
+    {
+        search_end = size - END_OF_CENTRAL_DIRECTORY_SIZE - 0xffff;
+    }
+    for (size_t pos = size - END_OF_CENTRAL_DIRECTORY_SIZE + 1; pos-- > search_end;)
+    {
+        if (read32(data + pos) == END_OF_CENTRAL_DIRECTORY_SIGNATURE)
+        {
+            end_record = data + pos;
+            break;
+        }
+    }
+    if (end_record == NULL)
+    {
+        return fail("not a zip archive");
+    }
+
+    uint16_t entry_count = read16(end_record + 10);
+    uint32_t directory_size = read32(end_record + 12);
+    uint32_t directory_offset = read32(end_record + 16);
+    if (entry_count == 0xffff || directory_offset == 0xffffffff)
+    {
+        return fail("zip64 archives are not supported");
+    }
+    if (uint64_t(directory_offset) + directory_size > size)
+    {
+        return fail("inconsistent central directory");
+    }
+
+    std::vector<Entry> entries;
+    entries.reserve(entry_count);
+    const unsigned char *pos = data + directory_offset;
+    const unsigned char *directory_end = pos + directory_size;
+    for (uint16_t i = 0; i < entry_count; i++)
+    {
+        if (directory_end - pos < ptrdiff_t(CENTRAL_HEADER_SIZE) || read32(pos) != CENTRAL_HEADER_SIGNATURE)
+        {
+            return fail("inconsistent central directory");
+        }
+        uint16_t name_length = read16(pos + 28);
+        uint16_t extra_length = read16(pos + 30);
+        uint16_t comment_length = read16(pos + 32);
+        size_t header_size = CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+        if (size_t(directory_end - pos) < header_size)
+        {
+            return fail("inconsistent central directory");
+        }
+
+        Entry entry;
+        entry.encrypted = read16(pos + 8) & 1;
+        entry.method = read16(pos + 10);
+        entry.crc = read32(pos + 16);
+        entry.compressed_size = read32(pos + 20);
+        entry.size = read32(pos + 24);
+        entry.local_header_offset = read32(pos + 42);
+        entry.name.assign((const char *) pos + CENTRAL_HEADER_SIZE, name_length);
+        entries.push_back(std::move(entry));
+
+        pos += header_size;
+    }
+
+    data_ = data;
+    size_ = size;
+    entries_ = std::move(entries);
+    return true;
+}
+
+bool MappedArchive::read(
+    const Entry &entry, std::vector<unsigned char> &buffer, const unsigned char *&data, size_t &size)
+{
+    if (entry.encrypted)
+    {
+        return fail("encrypted entry " + entry.name);
+    }
+    uint64_t offset = entry.local_header_offset;
+    if (offset + LOCAL_HEADER_SIZE > size_ || read32(data_ + offset) != LOCAL_HEADER_SIGNATURE)
+    {
+        return fail("inconsistent local header of " + entry.name);
+    }
+    // The local header has its own extra field, which may differ in length from the one of the central directory.
+    offset += LOCAL_HEADER_SIZE + read16(data_ + offset + 26) + read16(data_ + offset + 28);
+    if (offset + entry.compressed_size > size_)
+    {
+        return fail("truncated entry " + entry.name);
+    }
+    const unsigned char *compressed = data_ + offset;
+
+    if (entry.method == METHOD_STORED)
+    {
+        if (entry.compressed_size != entry.size)
+        {
+            return fail("inconsistent size of " + entry.name);
+        }
+        data = compressed;
+        size = entry.size;
+    }
+    else if (entry.method == METHOD_DEFLATED)
+    {
+        if (entry.size > max_inflated_size(entry.compressed_size))
+        {
+            return fail("impossible size of " + entry.name);
+        }
+        buffer.resize(entry.size);
+
+        z_stream stream = z_stream();
+        if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        {
+            return fail("can not initialize zlib");
+        }
+        stream.next_in = (Bytef *) compressed;
+        stream.avail_in = entry.compressed_size;
+        stream.next_out = buffer.data();
+        stream.avail_out = buffer.size();
+        int result = inflate(&stream, Z_FINISH);
+        size_t inflated = stream.total_out;
+        inflateEnd(&stream);
+        if (result != Z_STREAM_END || inflated != entry.size)
+        {
+            return fail("can not inflate " + entry.name);
+        }
+        data = buffer.data();
+        size = buffer.size();
+    }
+    else
+    {
+        return fail("unsupported compression method of " + entry.name);
+    }
+
+    if (crc32(crc32(0, Z_NULL, 0), data, size) != entry.crc)
+    {
+        return fail("crc error in " + entry.name);
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+/*
+ * zip_reader.hpp
+ *
+ * Minimal reader for the zip archives of .will files, working on a memory mapping.
+ */
+
+#ifndef ZIP_READER_HPP
+#define ZIP_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** the largest size an entry of compressed_size bytes can have once inflated.
+ *
+ * Deflate expands data by at most 1032 to 1. The uncompressed size in the header of an entry is checked against this
+ * before a buffer of that size is allocated, so a small crafted file can not claim gigabytes.
+ */
+inline uint64_t max_inflated_size(uint64_t compressed_size)
+{
+    return compressed_size * 1032 + 64;
+}
+
+/** a zip archive, which is read from memory.
+ *
+ * open() maps the file and reads the central directory. Only the pages of the central directory and of the entries
+ * that are read are touched. Stored entries are returned as pointer into the mapping, deflated entries are inflated
+ * into a caller owned buffer. Zip64, encryption and compression methods other than deflate are not supported.
+ */
+class MappedArchive
+{
+public:
+    struct Entry
+    {
+        std::string name;
+        bool encrypted;
+        uint16_t method;
+        uint32_t crc;
+        uint64_t compressed_size;
+        uint64_t size;
+        uint64_t local_header_offset;
+    };
+
+    MappedArchive() = default;
+    MappedArchive(const MappedArchive &) = delete;
+    MappedArchive &operator=(const MappedArchive &) = delete;
+    ~MappedArchive();
+
+    /** maps the file file_name and reads its central directory.
+     *
+     * @return false if the file can not be mapped or is no zip archive, see error().
+     */
+    bool open(const std::string &file_name);
+
+    /** reads the central directory of the archive in data, which has to outlive this.
+     *
+     * @return false if data is no zip archive, see error().
+     */
+    bool open(const unsigned char *data, size_t size);
+
+    const std::vector<Entry> &entries() const
+    {
+        return entries_;
+    }
+
+    /** gets the uncompressed content of entry.
+     *
+     * @param buffer receives the content of deflated entries. It can be reused for the next entry.
+     * @param data set to the content, either in the mapping or in buffer.
+     * @return false if the entry is damaged or can not be decompressed, see error().
+     */
+    bool read(const Entry &entry, std::vector<unsigned char> &buffer, const unsigned char *&data, size_t &size);
+
+    /** the reason the last call failed.
+     *
+     */
+    const std::string &error() const
+    {
+        return error_;
+    }
+
+private:
+    bool fail(const std::string &message);
+    void unmap();
+
+    const unsigned char *data_ = NULL;
+    size_t size_ = 0;
+    void *mapping_ = NULL;
+    std::vector<Entry> entries_;
+    std::string error_;
+};
+
+#endif